@@ -1,4 +1,5 @@
 #include "Accelerator.h"
+#include "SearchStats.h"
 
 namespace PinInCpp {
 	inline static bool utf8_string_end(const Utf8String& str, size_t index)noexcept {
@@ -6,16 +7,15 @@ namespace PinInCpp {
 	}
 
 	IndexSet Accelerator::get(const PinIn::Pinyin& p, size_t offset) {
-		if (cache.size() <= offset) {//检查是否过小
-			cache.resize(offset + 1);//过小触发resize，重设置大小
+		IndexSet ret;
+		if (!cache.get(offset, p.SyllableId, ret)) {//空结果也会被记住，不再重复匹配
+			PININCPP_STAT(MemoMisses++);
+			ret = p.match(asciiStr, offset, partial);
+			cache.set(offset, p.SyllableId, ret);
 		}
-		IndexSet::Storage& data = cache[offset];
-		IndexSet ret = data.get(p.id);
-		if (ret == IndexSet::NONE) {
-			ret = p.match(searchStr, offset, partial);
-			data.set(ret, static_cast<uint32_t>(p.id));
+		else {
+			PININCPP_STAT(MemoHits++);
 		}
-
 		return ret;
 	}
 
@@ -51,6 +51,7 @@ namespace PinInCpp {
 	}
 
 	bool Accelerator::check(size_t offset, size_t start) {
+		PININCPP_STATS_CHECK_DEPTH();
 		if (offset == searchStr.size()) {
 			return partial || provider->end(start);
 		}
@@ -7,15 +7,16 @@ namespace PinInCpp {
 		Accelerator(PinIn& p) : ctx{ p } {
 
 		}
-		const Utf8String& search() {
+		const Utf8String& search()const noexcept {
 			return searchStr;
 		}
-		const uint32_t searchU32FourCC(size_t i) {
+		uint32_t searchU32FourCC(size_t i)const noexcept {
 			return u32strVec[i];
 		}
 		void search(const std::string_view& s) {
 			if (s != searchStr.ToStream()) {
 				searchStr = std::string(s);
+				asciiStr.assign(searchStr);
 				u32strVec.clear();
 				for (const auto& v : searchStr) {
 					u32strVec.emplace_back(FourCCToU32(v));
@@ -24,12 +25,16 @@ namespace PinInCpp {
 			}
 		}
 		void reset() {
-			for (auto& v : cache) {
-				v.clear();//仅清空map容器，避免map对象再构造
+			cache.clear();//代数自增，O1清空
+		}
+		void setPartial(bool mode) {//和begins/matches内部的切换一样，模式变化时记忆的结果作废
+			if (partial != mode) {
+				partial = mode;
+				reset();
 			}
 		}
 		//接收一个外部的、长生命周期的provider，不拥有
-		void setProvider(UTF8StringPool* provider_ptr) {
+		void setProvider(const UTF8StringPool* provider_ptr) {
 			provider = provider_ptr;
 		}
 
@@ -40,15 +45,22 @@ namespace PinInCpp {
 		bool matches(size_t offset, size_t start);
 		bool begins(size_t offset, size_t start);
 		bool contains(size_t offset, size_t start);
-		const Utf8String& getSearchStr() {
+		const Utf8String& getSearchStr()const noexcept {
 			return searchStr;
 		}
+		const AsciiQuery& searchAscii()const noexcept {//音素匹配用的ASCII视图
+			return asciiStr;
+		}
+		size_t MemoryUsage()const noexcept {//记忆表和搜索串的几份拷贝，单位是字节
+			return cache.MemoryUsage() + searchStr.MemoryUsage() + asciiStr.MemoryUsage() + HeapBytes(u32strVec);
+		}
 	private:
-		UTF8StringPool* provider = nullptr;     //观察者指针，不拥有
+		const UTF8StringPool* provider = nullptr;     //观察者指针，不拥有
 
 		PinIn& ctx;
-		std::vector<IndexSet::Storage> cache;
+		IndexSet::MemoTable cache;
 		Utf8String searchStr;
+		AsciiQuery asciiStr;
 		std::vector<uint32_t> u32strVec;
 		bool partial = false;
 	};
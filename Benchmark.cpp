@@ -0,0 +1,469 @@
+/*
+	非交互的性能基准，用来发现性能回退和估算部署规模，不是核心代码库之一
+
+	测量项目：PinIn加载耗时(文本和二进制字典)、各个Logic下TreeSearcher::put的吞吐、查询延迟的分位数、ParallelSearch按TreeNum的扩展性，以及每个阶段结束时的峰值内存(RSS)，字典和树另外附带MemoryUsage()统计的堆内存
+	数据默认用small.txt和pinyin.txt，--synthetic N按small.txt的字符分布生成N条合成数据，用来测100万/1000万条量级的目录
+
+	用法：PinInBenchmark [选项]
+		--dict <路径>        拼音字典，默认pinyin.txt
+		--data <路径>        数据文件，每行一条，默认small.txt
+		--synthetic <N>      不读数据文件，生成N条合成数据
+		--seed <N>           合成数据和查询集的随机种子，默认1
+		--queries <N>        随机生成的查询数，默认2000，另外还有一组固定查询
+		--logic <列表>       要测的Logic，逗号分隔，可选begin,contain,equal，默认全部
+		--trees <列表>       ParallelSearch的TreeNum，逗号分隔，默认1,2,4,8，传0跳过
+		--out <路径>         结果写入文件，默认写到标准输出
+
+	结果是一个JSON对象，results里每一项是一个测量结果，进度信息输出到标准错误
+	用PININCPP_STATS构建时，tree_query还会附带每个查询平均的节点访问数、记忆表命中率等统计，此时的耗时包含统计本身的开销
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+
+#include "TreeSearcher.h"
+#include "ParallelSearch.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace PinInCpp;
+using BenchClock = std::chrono::steady_clock;
+
+static double ElapsedMS(BenchClock::time_point start, BenchClock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static size_t PeakRssKB() {//进程到目前为止的峰值常驻内存，单位KB
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return pmc.PeakWorkingSetSize / 1024;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return static_cast<size_t>(usage.ru_maxrss) / 1024;//macOS的单位是字节
+#else
+	return static_cast<size_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+struct Options {
+	std::string dict = "pinyin.txt";
+	std::string data = "small.txt";
+	size_t synthetic = 0;
+	uint64_t seed = 1;
+	size_t queries = 2000;
+	std::vector<Logic> logics = { Logic::BEGIN, Logic::CONTAIN, Logic::EQUAL };
+	std::vector<size_t> trees = { 1, 2, 4, 8 };
+	std::string out;
+};
+
+static const char* LogicName(Logic logic) {
+	switch (logic) {
+	case Logic::BEGIN:
+		return "begin";
+	case Logic::CONTAIN:
+		return "contain";
+	case Logic::EQUAL:
+		return "equal";
+	}
+	return "unknown";
+}
+
+static std::vector<std::string> SplitList(const std::string& s) {
+	std::vector<std::string> result;
+	std::stringstream ss(s);
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		if (!item.empty()) {
+			result.push_back(item);
+		}
+	}
+	return result;
+}
+
+static Options ParseOptions(int argc, char** argv) {
+	Options opt;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			throw std::invalid_argument("missing value for " + arg);
+		}
+		const std::string value = argv[++i];
+		if (arg == "--dict") {
+			opt.dict = value;
+		}
+		else if (arg == "--data") {
+			opt.data = value;
+		}
+		else if (arg == "--synthetic") {
+			opt.synthetic = std::stoull(value);
+		}
+		else if (arg == "--seed") {
+			opt.seed = std::stoull(value);
+		}
+		else if (arg == "--queries") {
+			opt.queries = std::stoull(value);
+		}
+		else if (arg == "--logic") {
+			opt.logics.clear();
+			for (const std::string& name : SplitList(value)) {
+				if (name == "begin") {
+					opt.logics.push_back(Logic::BEGIN);
+				}
+				else if (name == "contain") {
+					opt.logics.push_back(Logic::CONTAIN);
+				}
+				else if (name == "equal") {
+					opt.logics.push_back(Logic::EQUAL);
+				}
+				else {
+					throw std::invalid_argument("unknown logic " + name);
+				}
+			}
+		}
+		else if (arg == "--trees") {
+			opt.trees.clear();
+			for (const std::string& n : SplitList(value)) {
+				if (std::stoull(n) != 0) {
+					opt.trees.push_back(std::stoull(n));
+				}
+			}
+		}
+		else if (arg == "--out") {
+			opt.out = value;
+		}
+		else {
+			throw std::invalid_argument("unknown option " + arg);
+		}
+	}
+	return opt;
+}
+
+//结果收集成JSON，字段只有字符串和数字两种
+class JsonResult {
+public:
+	JsonResult& add(const std::string& key, const std::string& value) {
+		fields.push_back("\"" + key + "\": \"" + Escape(value) + "\"");
+		return *this;
+	}
+	JsonResult& add(const std::string& key, double value) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%.6g", value);
+		fields.push_back("\"" + key + "\": " + buf);
+		return *this;
+	}
+	JsonResult& add(const std::string& key, size_t value) {
+		fields.push_back("\"" + key + "\": " + std::to_string(value));
+		return *this;
+	}
+	std::string str()const {
+		std::string result = "{";
+		for (size_t i = 0; i < fields.size(); i++) {
+			result += (i == 0 ? "" : ", ") + fields[i];
+		}
+		return result + "}";
+	}
+private:
+	static std::string Escape(const std::string& s) {
+		std::string result;
+		for (const char c : s) {
+			if (c == '"' || c == '\\') {
+				result.push_back('\\');
+			}
+			result.push_back(c);
+		}
+		return result;
+	}
+	std::vector<std::string> fields;
+};
+
+static std::vector<std::string> LoadLines(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("cannot open " + path);
+	}
+	std::vector<std::string> lines;
+	std::string line;
+	while (std::getline(file, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty()) {
+			lines.push_back(line);
+		}
+	}
+	return lines;
+}
+
+//按样本里的字符频率生成合成数据，长度分布也取自样本，合成的条目和真实目录的匹配难度相近
+static std::vector<std::string> Synthesize(const std::vector<std::string>& sample, size_t count, uint64_t seed) {
+	std::vector<std::string> chars;
+	std::vector<size_t> lengths;
+	for (const std::string& s : sample) {
+		Utf8StringView view(s);
+		lengths.push_back(view.size());
+		for (const auto& c : view) {
+			chars.emplace_back(c);
+		}
+	}
+	if (chars.empty()) {
+		throw std::runtime_error("sample data is empty");
+	}
+	std::mt19937_64 rng(seed);
+	std::uniform_int_distribution<size_t> PickChar(0, chars.size() - 1);
+	std::uniform_int_distribution<size_t> PickLength(0, lengths.size() - 1);
+	std::vector<std::string> result;
+	result.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		const size_t length = std::max<size_t>(lengths[PickLength(rng)], 1);
+		std::string s;
+		for (size_t k = 0; k < length; k++) {
+			s += chars[PickChar(rng)];
+		}
+		result.push_back(std::move(s));
+	}
+	return result;
+}
+
+//固定查询覆盖短前缀、全拼、首字母和原文，随机查询从数据里截取一段，转成全拼、首字母或者保持原文
+static std::vector<std::string> MakeQueries(const PinIn& pinin, const std::vector<std::string>& data, size_t count, uint64_t seed) {
+	std::vector<std::string> queries = { "a", "z", "zh", "zhong", "dianchi", "yjdc", "wuxian", "jingti", "c", "sj", "ceshi", "lv", "yuanzi", "123" };
+	std::mt19937_64 rng(seed + 1);
+	for (size_t i = 0; i < count && !data.empty(); i++) {
+		Utf8StringView view(data[rng() % data.size()]);
+		if (view.size() == 0) {
+			continue;
+		}
+		const size_t start = rng() % view.size();
+		const size_t length = std::min<size_t>(1 + rng() % 4, view.size() - start);
+		const size_t mode = rng() % 3;
+		std::string query;
+		for (size_t k = start; k < start + length; k++) {
+			const std::string_view ch = view[k];
+			std::vector<std::string_view> pinyins = pinin.GetPinyinView(ch);
+			if (mode == 2 || pinyins.empty() || pinyins[0].empty()) {
+				query += ch;
+			}
+			else if (mode == 0) {
+				query += pinyins[0];
+			}
+			else {
+				query += pinyins[0][0];
+			}
+		}
+		queries.push_back(std::move(query));
+	}
+	return queries;
+}
+
+struct Latency {
+	double total = 0;
+	double mean = 0;
+	double p50 = 0;
+	double p90 = 0;
+	double p99 = 0;
+	double max = 0;
+	size_t results = 0;
+};
+
+//每个查询先预热一轮，第二轮逐个计时
+template<typename SearchFunc>
+static Latency MeasureQueries(const std::vector<std::string>& queries, SearchFunc&& search) {
+	for (const std::string& q : queries) {
+		search(q);
+	}
+	std::vector<double> times;
+	times.reserve(queries.size());
+	Latency result;
+	for (const std::string& q : queries) {
+		const BenchClock::time_point start = BenchClock::now();
+		result.results += search(q);
+		times.push_back(ElapsedMS(start, BenchClock::now()));
+	}
+	if (times.empty()) {
+		return result;
+	}
+	std::sort(times.begin(), times.end());
+	auto percentile = [&times](double p) {
+		return times[std::min(times.size() - 1, static_cast<size_t>(p * static_cast<double>(times.size())))];
+	};
+	for (const double t : times) {
+		result.total += t;
+	}
+	result.mean = result.total / static_cast<double>(times.size());
+	result.p50 = percentile(0.5);
+	result.p90 = percentile(0.9);
+	result.p99 = percentile(0.99);
+	result.max = times.back();
+	return result;
+}
+
+static void AddLatency(JsonResult& r, const Latency& l) {
+	r.add("queries_ms_total", l.total).add("mean_ms", l.mean).add("p50_ms", l.p50).add("p90_ms", l.p90)
+		.add("p99_ms", l.p99).add("max_ms", l.max).add("results", l.results);
+}
+
+static void AddStats(JsonResult& r, const SearchStatsCollector::Summary& s) {
+	if (s.queries == 0) {
+		return;
+	}
+	const double n = static_cast<double>(s.queries);
+	const SearchStats& t = s.total;
+	const size_t memo = t.MemoHits + t.MemoMisses;
+	r.add("nodes_per_query", static_cast<double>(t.NodesVisited()) / n)
+		.add("memo_hit_rate", memo == 0 ? 0.0 : static_cast<double>(t.MemoHits) / static_cast<double>(memo))
+		.add("phoneme_matches_per_query", static_cast<double>(t.PhonemeMatches) / n)
+		.add("check_calls_per_query", static_cast<double>(t.CheckCalls) / n)
+		.add("max_check_depth", t.MaxCheckDepth)
+		.add("raw_results", t.RawResults).add("unique_results", t.UniqueResults)
+		.add("prepare_ms", static_cast<double>(t.PrepareNs) / 1e6).add("traverse_ms", static_cast<double>(t.TraverseNs) / 1e6)
+		.add("collect_ms", static_cast<double>(t.CollectNs) / 1e6);
+	if (!s.slowest.empty()) {
+		r.add("slowest_query", s.slowest.front().first);
+	}
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> results;
+	Options opt;
+	try {
+		opt = ParseOptions(argc, argv);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		return 2;
+	}
+
+	std::cerr << "loading dictionary\n";
+	BenchClock::time_point start = BenchClock::now();
+	std::shared_ptr<PinIn> pinin = std::make_shared<PinIn>(opt.dict);
+	double ms = ElapsedMS(start, BenchClock::now());
+	results.push_back(JsonResult().add("bench", "dict_load").add("format", "text").add("ms", ms)
+		.add("heap_bytes", pinin->MemoryUsage().total()).add("peak_rss_kb", PeakRssKB()).str());
+	{
+		const std::string BinaryPath = opt.dict + ".bench.bin";
+		pinin->SaveBinary(BinaryPath);
+		size_t BinaryHeap = 0;
+		start = BenchClock::now();
+		{
+			PinIn binary(BinaryPath);
+			ms = ElapsedMS(start, BenchClock::now());
+			BinaryHeap = binary.MemoryUsage().total();
+		}
+		std::remove(BinaryPath.c_str());
+		results.push_back(JsonResult().add("bench", "dict_load").add("format", "binary").add("ms", ms)
+			.add("heap_bytes", BinaryHeap).add("peak_rss_kb", PeakRssKB()).str());
+	}
+
+	std::vector<std::string> data;
+	try {
+		data = LoadLines(opt.data);
+		if (opt.synthetic != 0) {
+			std::cerr << "generating " << opt.synthetic << " synthetic entries\n";
+			data = Synthesize(data, opt.synthetic, opt.seed);
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	size_t DataBytes = 0;
+	for (const std::string& s : data) {
+		DataBytes += s.size();
+	}
+	const std::vector<std::string> queries = MakeQueries(*pinin, data, opt.queries, opt.seed);
+
+	for (const Logic logic : opt.logics) {
+		std::cerr << "TreeSearcher " << LogicName(logic) << "\n";
+		TreeSearcher tree(logic, pinin);
+		start = BenchClock::now();
+		for (const std::string& s : data) {
+			tree.put(s);
+		}
+		ms = ElapsedMS(start, BenchClock::now());
+		const TreeSearcher::MemoryReport mem = tree.MemoryUsage();
+		results.push_back(JsonResult().add("bench", "tree_put").add("logic", LogicName(logic)).add("entries", data.size())
+			.add("ms", ms).add("entries_per_sec", static_cast<double>(data.size()) / (ms / 1000))
+			.add("heap_bytes", mem.total()).add("strs_bytes", mem.strs.total())
+			.add("node_bytes", mem.DenseNodes.bytes + mem.SliceNodes.bytes + mem.MapNodes.bytes + mem.AccNodes.bytes)
+			.add("objset_bytes", mem.ObjSets).add("acc_index_bytes", mem.AccIndex).add("free_list_bytes", mem.FreeLists)
+			.add("peak_rss_kb", PeakRssKB()).str());
+
+		TreeSearcher::SearchContext ctx(tree);
+		auto collector = std::make_shared<SearchStatsCollector>(1);
+		if (SearchStats::enabled) {
+			tree.SetStatsCollector(collector);
+		}
+		JsonResult query;
+		query.add("bench", "tree_query").add("logic", LogicName(logic)).add("entries", data.size()).add("queries", queries.size());
+		AddLatency(query, MeasureQueries(queries, [&tree, &ctx](const std::string& q) {
+			return tree.ExecuteSearchView(ctx, q).size();
+		}));
+		AddStats(query, collector->summary());
+		results.push_back(query.add("peak_rss_kb", PeakRssKB()).str());
+	}
+
+	for (const size_t TreeNum : opt.trees) {
+		std::cerr << "ParallelSearch TreeNum=" << TreeNum << "\n";
+		ParallelSearch ps(Logic::CONTAIN, pinin, TreeNum);
+		start = BenchClock::now();
+		for (const std::string& s : data) {
+			ps.put(s);
+		}
+		ms = ElapsedMS(start, BenchClock::now());
+		results.push_back(JsonResult().add("bench", "parallel_put").add("logic", "contain").add("trees", TreeNum).add("entries", data.size())
+			.add("ms", ms).add("entries_per_sec", static_cast<double>(data.size()) / (ms / 1000)).add("peak_rss_kb", PeakRssKB()).str());
+
+		JsonResult query;
+		query.add("bench", "parallel_query").add("logic", "contain").add("trees", TreeNum).add("entries", data.size()).add("queries", queries.size());
+		AddLatency(query, MeasureQueries(queries, [&ps](const std::string& q) {
+			return ps.ExecuteSearchView(q).size();
+		}));
+		results.push_back(query.add("peak_rss_kb", PeakRssKB()).str());
+	}
+
+	std::ostringstream json;
+	json << "{\n  \"config\": " << JsonResult().add("dict", opt.dict).add("data", opt.synthetic != 0 ? "synthetic" : opt.data)
+		.add("entries", data.size()).add("data_bytes", DataBytes).add("seed", static_cast<size_t>(opt.seed))
+		.add("index_width", sizeof(PoolIndex)).add("hardware_threads", static_cast<size_t>(std::thread::hardware_concurrency())).str();
+	json << ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		json << "    " << results[i] << (i + 1 == results.size() ? "\n" : ",\n");
+	}
+	json << "  ]\n}\n";
+	if (opt.out.empty()) {
+		std::cout << json.str();
+	}
+	else {
+		std::ofstream file(opt.out, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "cannot open " << opt.out << "\n";
+			return 1;
+		}
+		file << json.str();
+	}
+	return 0;
+}
@@ -4,4 +4,18 @@ namespace PinInCpp {
 	const IndexSet IndexSet::ZERO = IndexSet::Init(1);
 	const IndexSet IndexSet::ONE = IndexSet::Init(2);
 	const IndexSet IndexSet::NONE = IndexSet::Init();
+
+	void IndexSet::MemoTable::grow() {
+		std::vector<Slot> old = std::move(slots);
+		bits++;
+		slots = std::vector<Slot>(old.size() * 2);
+		const uint32_t current = epoch;
+		epoch = 1;//新表里所有槽位都是0代，重新从1开始
+		count = 0;
+		for (const Slot& slot : old) {
+			if (slot.epoch == current) {
+				set(slot.key >> 32, static_cast<uint32_t>(slot.key), IndexSet::Init(slot.value));
+			}
+		}
+	}
 }
@@ -2,6 +2,8 @@
 #include <functional>
 #include <unordered_map>
 #include <iostream>
+#include <vector>
+#include <cstdint>
 namespace PinInCpp {
 	constexpr static uint32_t IndexSetIterEnd = static_cast<uint32_t>(-1);
 
@@ -23,8 +25,8 @@ namespace PinInCpp {
 		void set(uint32_t index)noexcept {
 			value |= (0x1 << index);
 		}
-		bool get(uint32_t index)const noexcept {
-			return (value & (0x1 << index)) != 0;
+		bool get(uint32_t index)const noexcept {//超出32位的下标不可能被set过，直接返回false，避免越界移位
+			return index < 32 && (value & (0x1u << index)) != 0;
 		}
 		void merge(const IndexSet s)noexcept {//平凡类型本质上可以被优化为基本类型，而基本类型在传递时，值传递比引用传递快
 			value = value == 0x1 ? s.value : (value | s.value);
@@ -68,23 +70,74 @@ namespace PinInCpp {
 			return IndexSetIterObj::Init(value);
 		}
 
-		class Storage {
+		//Accelerator的记忆表，以(偏移量, 音节序号)为键，开放寻址+线性探测的平坦哈希表
+		//用代数(epoch)标记槽位的有效性，clear只需要让代数自增，不需要遍历清空
+		class MemoTable {
 		public:
-			void set(const IndexSet is, uint32_t index) {//同merge方法注释
-				data.insert_or_assign(index, is.value + 1);
+			MemoTable() :slots(InitCapacity) {}
+			//查到了返回真，并通过result返回，空的IndexSet也是合法的结果
+			bool get(size_t offset, size_t id, IndexSet& result)const noexcept {
+				const uint64_t key = MakeKey(offset, id);
+				for (size_t i = hash(key);; i = (i + 1) & (slots.size() - 1)) {
+					const Slot& slot = slots[i];
+					if (slot.epoch != epoch) {//遇到空槽，不存在
+						return false;
+					}
+					if (slot.key == key) {
+						result.value = slot.value;
+						return true;
+					}
+				}
 			}
-			IndexSet get(size_t index) {
-				auto it = data.find(index);
-				if (it == data.end() || it->second == 0) {
-					return IndexSet::Init();//空IndexSet也可以代表空元素，而且因为只有uint32_t成员，根本不耗性能
+			void set(size_t offset, size_t id, const IndexSet is) {
+				if ((count + 1) * 2 > slots.size()) {//负载因子保持在0.5以下
+					grow();
+				}
+				const uint64_t key = MakeKey(offset, id);
+				for (size_t i = hash(key);; i = (i + 1) & (slots.size() - 1)) {
+					Slot& slot = slots[i];
+					if (slot.epoch != epoch) {
+						slot = { key, epoch, is.value };
+						count++;
+						return;
+					}
+					if (slot.key == key) {
+						slot.value = is.value;
+						return;
+					}
 				}
-				return IndexSet::Init(it->second - 1);
 			}
-			void clear() {//仅删除键值对，不进行析构对象
-				data.clear();
+			size_t MemoryUsage()const noexcept {//槽位数组的字节数，只增不减
+				return slots.capacity() * sizeof(Slot);
+			}
+			void clear() noexcept {//O1清空，代数回绕时才需要真正清空一次
+				count = 0;
+				epoch++;
+				if (epoch == 0) {
+					for (Slot& slot : slots) {
+						slot.epoch = 0;
+					}
+					epoch = 1;
+				}
 			}
 		private:
-			std::unordered_map<size_t, uint32_t>data;
+			struct Slot {
+				uint64_t key;
+				uint32_t epoch;
+				uint32_t value;
+			};
+			static constexpr size_t InitCapacity = 1024;//必须是2的幂
+			static uint64_t MakeKey(size_t offset, size_t id) noexcept {//偏移量和音节序号都不会超过32位
+				return (static_cast<uint64_t>(offset) << 32) | static_cast<uint32_t>(id);
+			}
+			size_t hash(uint64_t key)const noexcept {//斐波那契哈希，取高位
+				return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+			}
+			void grow();
+			std::vector<Slot> slots;//epoch为0的槽位永远是空的，当前代数从1开始
+			size_t count = 0;
+			uint32_t epoch = 1;
+			uint32_t bits = 10;//log2(slots.size())
 		};
 	private:
 		uint32_t value;
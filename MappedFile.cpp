@@ -0,0 +1,93 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace PinInCpp {
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string_view& path) {
+		HANDLE f = CreateFileA(std::string(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (f == INVALID_HANDLE_VALUE) {
+			return;
+		}
+		file = f;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(f, &fileSize)) {
+			return;
+		}
+		length = static_cast<size_t>(fileSize.QuadPart);
+		if (length == 0) {//空文件无法创建映射，但它本身是合法的
+			opened = true;
+			return;
+		}
+		HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m == nullptr) {
+			length = 0;
+			return;
+		}
+		mapping = m;
+		view = static_cast<const char*>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+		if (view == nullptr) {
+			length = 0;
+			return;
+		}
+		opened = true;
+	}
+
+	MappedFile::~MappedFile() {
+		if (view != nullptr) {
+			UnmapViewOfFile(view);
+		}
+		if (mapping != nullptr) {
+			CloseHandle(mapping);
+		}
+		if (file != nullptr) {
+			CloseHandle(file);
+		}
+	}
+#else
+	MappedFile::MappedFile(const std::string_view& path) {
+		int fd = open(std::string(path).c_str(), O_RDONLY);
+		if (fd == -1) {
+			return;
+		}
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			close(fd);
+			return;
+		}
+		length = static_cast<size_t>(st.st_size);
+		if (length == 0) {//空文件无法创建映射，但它本身是合法的
+			close(fd);
+			opened = true;
+			return;
+		}
+		void* ptr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);//映射建立后文件描述符就不需要了
+		if (ptr == MAP_FAILED) {
+			length = 0;
+			return;
+		}
+		view = static_cast<const char*>(ptr);
+		opened = true;
+	}
+
+	MappedFile::~MappedFile() {
+		if (view != nullptr) {
+			munmap(const_cast<char*>(view), length);
+		}
+	}
+#endif
+}
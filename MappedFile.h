@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+namespace PinInCpp {
+	/*
+	只读的文件内存映射，供二进制拼音字典之类的数据原地使用
+
+	映射是只读且共享的，同一台机器上的多个进程映射同一个文件时，操作系统只会保留一份物理页
+	*/
+	class MappedFile {
+	public:
+		MappedFile(const std::string_view& path);
+		~MappedFile();
+		//持有的是系统句柄，不能移动和拷贝
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) = delete;
+		MappedFile& operator=(MappedFile&& src) = delete;
+
+		bool IsOpen()const noexcept {//打开失败时为假，空文件是合法的，但data()为空指针
+			return opened;
+		}
+		const char* data()const noexcept {
+			return view;
+		}
+		size_t size()const noexcept {
+			return length;
+		}
+	private:
+		const char* view = nullptr;
+		size_t length = 0;
+		bool opened = false;
+#ifdef _WIN32
+		void* file = nullptr;//HANDLE，避免在头文件里引入windows.h
+		void* mapping = nullptr;
+#endif
+	};
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+
+/*
+内存统计用的辅助函数，各个类的MemoryUsage()用它们按容器的容量计算堆内存
+
+统计的是向分配器申请的字节数，不含分配器自身的簿记和对齐取整
+std::vector和std::string按capacity()计算，是精确的
+无序容器的节点和桶数组布局是标准库的实现细节，这里不依赖任何一家的内部定义，按常见的布局估算：
+每个节点是元素加两个指针大小(链表指针，以及缓存的哈希值或者双向链表的另一个指针)，桶数组每个桶一个指针
+所以包含无序容器的那部分是估算值，和实际分配的字节数会有小的出入
+*/
+
+namespace PinInCpp {
+	namespace MemoryDetail {
+		template<typename Value>
+		constexpr size_t HashNodeBytes() noexcept {
+			return sizeof(Value) + 2 * sizeof(void*);
+		}
+		template<typename Value>
+		size_t HashTableBytes(size_t size, size_t buckets)noexcept {
+			return size * HashNodeBytes<Value>() + buckets * sizeof(void*);
+		}
+	}
+
+	template<typename T, typename Alloc>
+	size_t HeapBytes(const std::vector<T, Alloc>& v)noexcept {
+		return v.capacity() * sizeof(T);
+	}
+	inline size_t HeapBytes(const std::string& s)noexcept {//短字符串存在对象内部，不占堆内存
+		const char* p = s.data();
+		const char* self = reinterpret_cast<const char*>(&s);
+		if (p >= self && p < self + sizeof(std::string)) {
+			return 0;
+		}
+		return s.capacity() + 1;
+	}
+	//只是容器本身的节点和桶数组的估算，元素自己持有的堆内存由调用方另外计算
+	template<typename K, typename V, typename Hash, typename Eq, typename Alloc>
+	size_t HeapBytes(const std::unordered_map<K, V, Hash, Eq, Alloc>& m)noexcept {
+		return MemoryDetail::HashTableBytes<std::pair<const K, V>>(m.size(), m.bucket_count());
+	}
+	template<typename K, typename Hash, typename Eq, typename Alloc>
+	size_t HeapBytes(const std::unordered_set<K, Hash, Eq, Alloc>& s)noexcept {
+		return MemoryDetail::HashTableBytes<K>(s.size(), s.bucket_count());
+	}
+}
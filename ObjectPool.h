@@ -5,6 +5,10 @@
 #include <memory>
 #include <type_traits>
 #include <functional>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
 
 namespace PinInCpp {
 	//本质上是接管用不到的对象指针，在需要的时候重新构造/构造一个新的对象，如果你自己回收了也没问题，因为分配出去后权限归你
@@ -231,4 +235,103 @@ namespace PinInCpp {
 		size_t nextpos = 0;
 		bool lastRenewUnfinished = false;
 	};
+
+	//竞技场式的分块对象池，对象用32位下标而不是指针引用，同一块内的对象是连续存放的
+	//按块扩容，已有对象的地址不会因为扩容而改变，所以在持有某个对象的引用时继续分配新对象是安全的
+	//回收的对象会立即析构，下标进入空闲列表等待复用
+	template<typename T, size_t ChunkBits = 10>
+	class SlabPool {
+	public:
+		static_assert(!std::is_array_v<T>, "Cannot process c array");
+		static constexpr size_t ChunkSize = static_cast<size_t>(1) << ChunkBits;
+
+		SlabPool() = default;
+		~SlabPool() {
+			clear();
+		}
+		SlabPool(const SlabPool&) = delete;
+		SlabPool(SlabPool&&) = delete;
+		SlabPool& operator=(SlabPool&&) = delete;
+
+		T& operator[](uint32_t i) noexcept {
+			return *reinterpret_cast<T*>(chunks[i >> ChunkBits][i & (ChunkSize - 1)].b);
+		}
+		const T& operator[](uint32_t i)const noexcept {
+			return *reinterpret_cast<const T*>(chunks[i >> ChunkBits][i & (ChunkSize - 1)].b);
+		}
+		template<typename... _Types>
+		uint32_t NewObj(_Types&&..._Args) {//构造一个对象并返回其下标
+			if (!FreeList.empty()) {
+				uint32_t result = FreeList.back();
+				new (&(*this)[result]) T(std::forward<_Types>(_Args)...);
+				FreeList.pop_back();//构造成功后再弹出，构造函数抛出异常时相当于没分配
+				return result;
+			}
+			if (count == chunks.size() * ChunkSize) {
+				chunks.push_back(std::make_unique<Block[]>(ChunkSize));
+			}
+			uint32_t result = static_cast<uint32_t>(count);
+			new (&(*this)[result]) T(std::forward<_Types>(_Args)...);
+			count++;//同上，构造完成后再移动标记
+			return result;
+		}
+		void FreeToPool(uint32_t i) {//立即析构，释放对象持有的资源
+			(*this)[i].~T();
+			FreeList.push_back(i);
+		}
+		//已经分配出去的下标上限，包括已回收的，遍历时应跳过IsFree为真的
+		size_t size()const noexcept {
+			return count;
+		}
+		size_t LiveSize()const noexcept {
+			return count - FreeList.size();
+		}
+		size_t FreeSize()const noexcept {
+			return FreeList.size();
+		}
+		bool IsFree(uint32_t i)const noexcept {//线性查找，只适合调试和低频场景
+			return std::find(FreeList.begin(), FreeList.end(), i) != FreeList.end();
+		}
+		void ShrinkFreeList() {//释放空闲列表多余的容量
+			FreeList.shrink_to_fit();
+		}
+		template<typename Fn>
+		void ForEach(Fn fn)const {//按下标顺序遍历存活的对象
+			std::vector<uint32_t> freed = FreeList;
+			std::sort(freed.begin(), freed.end());
+			size_t cursor = 0;
+			for (size_t i = 0; i < count; i++) {
+				if (cursor < freed.size() && freed[cursor] == i) {
+					cursor++;
+					continue;
+				}
+				fn((*this)[static_cast<uint32_t>(i)]);
+			}
+		}
+		size_t MemoryUsage()const noexcept {//所有块(包括空闲和还没用到的槽位)、块表和空闲列表的字节数，不含对象自己持有的堆内存
+			return chunks.size() * ChunkSize * sizeof(T) + chunks.capacity() * sizeof(std::unique_ptr<Block[]>) + FreeList.capacity() * sizeof(uint32_t);
+		}
+		void clear() {//析构所有存活的对象并释放全部内存
+			std::vector<uint32_t> freed = std::move(FreeList);
+			std::sort(freed.begin(), freed.end());
+			size_t cursor = 0;
+			for (size_t i = 0; i < count; i++) {
+				if (cursor < freed.size() && freed[cursor] == i) {
+					cursor++;
+					continue;
+				}
+				(*this)[static_cast<uint32_t>(i)].~T();
+			}
+			chunks.clear();
+			FreeList.clear();
+			count = 0;
+		}
+	private:
+		struct Block {
+			alignas(T) std::byte b[sizeof(T)];
+		};
+		std::vector<std::unique_ptr<Block[]>> chunks;
+		std::vector<uint32_t> FreeList;
+		size_t count = 0;
+	};
 }
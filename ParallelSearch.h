@@ -1,43 +1,65 @@
 #pragma once
-#include <thread>
-#include <barrier>
 #include <mutex>
+#include <condition_variable>
+#include <future>
+#include <exception>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <deque>
 
 #include "TreeSearcher.h"
+#include "WorkStealingPool.h"
 
 namespace PinInCpp {
-	class ParallelSearch {//并行搜索树逻辑，如果数据量比较小（如4w行），则无明显效果，按需使用
+	/*
+	并行搜索树逻辑，如果数据量比较小（如4w行），则无明显效果，按需使用
+
+	每次搜索把各棵树的搜索作为任务提交到内置的工作窃取线程池，多个线程可以同时调用搜索接口，各自的任务在线程池里交错执行
+	搜索之间共享只读的树，put/Freeze这类修改操作会等待进行中的搜索结束，修改期间新的搜索会等待修改完成
+
+	一次搜索的耗时取决于最慢的那棵树，所以put按开销把条目分给当前开销最小的树，而不是轮流分配
+	开销是插入树中的后缀数，CONTAIN下是字符串的字符数，其他逻辑下每个条目都是1
+	各棵树的搜索耗时会被持续统计，Rebalance()按实测的单位耗时重新估算每个条目的开销，把条目重新分配到各棵树
+	*/
+	class ParallelSearch {
 	public:
 		ParallelSearch(Logic logic, const std::string_view& PinyinDictionaryPath, size_t TreeNum)
-			:context(std::make_shared<PinIn>(PinyinDictionaryPath)), TreeNum{ TreeNum }, barrier(TreeNum + 1) {
+			:context(std::make_shared<PinIn>(PinyinDictionaryPath)), TreeNum{ TreeNum }, pool(TreeNum) {
 			init(logic);
 		}
 		ParallelSearch(Logic logic, const std::vector<char>& PinyinDictionaryData, size_t TreeNum)
-			:context(std::make_shared<PinIn>(PinyinDictionaryData)), TreeNum{ TreeNum }, barrier(TreeNum + 1) {
+			:context(std::make_shared<PinIn>(PinyinDictionaryData)), TreeNum{ TreeNum }, pool(TreeNum) {
 			init(logic);
 		}
 		ParallelSearch(Logic logic, std::shared_ptr<PinIn> PinInShared, size_t TreeNum)
-			:context(PinInShared), TreeNum{ TreeNum }, barrier(TreeNum + 1) {//工作线程数 + 1 (主线程),主线程被堵塞等待搜索完成
+			:context(PinInShared), TreeNum{ TreeNum }, pool(TreeNum) {//工作线程数和树的数量一致
 			init(logic);
 		}
-		~ParallelSearch() {
-			if (!StopFlag) {
-				StopFlag = true;
-				barrier.arrive_and_wait();
-			}
-			for (auto& v : ThreadPool) {
-				if (v.joinable()) {
-					v.join();
-				}
+		~ParallelSearch() {//等待还没完成的异步搜索和它们的done，不要在done里销毁这个对象
+			{
+				std::unique_lock<std::mutex> lk(DoneMtx);
+				DoneCv.wait(lk, [this]() {
+					return AsyncPending == 0;
+				});
+				DoneStop = true;
 			}
+			DoneCv.notify_all();
+			DoneThread.join();
 		}
 		ParallelSearch(const ParallelSearch&) = delete;
 		ParallelSearch(ParallelSearch&&) = delete;
 		ParallelSearch& operator=(ParallelSearch&& src) = delete;
 
-		std::vector<std::string> ExecuteSearch(const std::string_view& str) {//只需要一个线程执行这个函数即可并发搜索，不要用多个线程执行此函数
-			CommonSearch(str);
+		//异步搜索的完成回调，error不为空时result为空
+		//在这个对象专用的回调线程里按完成顺序逐个调用，不占用线程池的工作线程，所以done里可以put或者发起新的搜索，done耗时太长会推迟后面的回调
+		using SearchCallback = std::function<void(std::vector<std::string> result, std::exception_ptr error)>;
+
+		std::vector<std::string> ExecuteSearch(const std::string_view& str) {//可以被多个线程同时调用
+			ReadGuard guard(*this);
+			std::vector<std::vector<std::string_view>> ResultSet = CommonSearch(str);
 			std::vector<std::string> result;
+			result.reserve(ResultCount(ResultSet));
 			for (const auto& vec : ResultSet) {
 				for (const auto& str : vec) {
 					result.push_back(std::string(str));
@@ -45,9 +67,11 @@ namespace PinInCpp {
 			}
 			return result;
 		}
-		std::vector<std::string_view> ExecuteSearchView(const std::string_view& str) {//只需要一个线程执行这个函数即可并发搜索，不要用多个线程执行此函数。返回的只读视图会在插入后可能变成悬垂视图
-			CommonSearch(str);
+		std::vector<std::string_view> ExecuteSearchView(const std::string_view& str) {//可以被多个线程同时调用。返回的只读视图会在插入后可能变成悬垂视图
+			ReadGuard guard(*this);
+			std::vector<std::vector<std::string_view>> ResultSet = CommonSearch(str);
 			std::vector<std::string_view> result;
+			result.reserve(ResultCount(ResultSet));
 			for (const auto& vec : ResultSet) {
 				for (const auto& str : vec) {
 					result.push_back(str);
@@ -55,38 +79,165 @@ namespace PinInCpp {
 			}
 			return result;
 		}
-		//线程不安全，你应该在单线程内执行它
-		void put(const std::string_view& keyword) {
-			context->PreCacheString(keyword);//手动预热
-
-			ClearResultSet = true;//一个flag，通知搜索的时候清空结果集，因为put可能会导致视图失效
-			TreePool[NextIndex]->put(keyword);
-			NextIndex++;
-			if (NextIndex >= TreeNum) {
-				NextIndex = 0;
+		//执行搜索，各棵树的结果逐个交给回调，回调返回false时停止，不会拼接复制成新的数组。回调里不要修改这个对象
+		void ExecuteSearchStream(const std::string_view& str, const std::function<bool(std::string_view)>& callback) {
+			ReadGuard guard(*this);
+			for (const auto& vec : CommonSearch(str)) {
+				for (const auto& str : vec) {
+					if (!callback(str)) {
+						return;
+					}
+				}
 			}
 		}
+		//异步搜索，立即返回，调用线程不会被阻塞
+		std::future<std::vector<std::string>> ExecuteSearchAsync(const std::string_view& str) {
+			auto promise = std::make_shared<std::promise<std::vector<std::string>>>();
+			std::future<std::vector<std::string>> result = promise->get_future();
+			CommonAsync(str, [promise](std::vector<std::string> result, std::exception_ptr error) {
+				if (error) {
+					promise->set_exception(error);
+				}
+				else {
+					promise->set_value(std::move(result));
+				}
+			});
+			return result;
+		}
+		//异步搜索，完成后在回调线程里调用done
+		void ExecuteSearchAsync(const std::string_view& str, SearchCallback done) {
+			CommonAsync(str, std::move(done));
+		}
+		//会等待进行中的搜索结束
+		void put(const std::string_view& keyword) {
+			WriteGuard guard(*this);
+			const size_t cost = EntryCost(keyword);
+			const size_t index = static_cast<size_t>(std::min_element(shards.begin(), shards.end(), [](const ShardStats& a, const ShardStats& b) {
+				return a.cost < b.cost;
+			}) - shards.begin());
+			TreePool[index]->put(keyword);
+			shards[index].entries++;
+			shards[index].cost += cost;
+		}
 		size_t GetTreeNum()const noexcept {
 			return TreeNum;
 		}
 
+		struct ShardStats {//一棵树的分片统计
+			size_t entries = 0;//条目数
+			size_t cost = 0;//后缀数
+			double AvgSearchNs = 0;//搜索耗时的指数移动平均，还没有搜索过时为0
+		};
+		std::vector<ShardStats> GetShardStats() {
+			ReadGuard guard(*this);//分片统计只在修改时变化
+			std::vector<ShardStats> result = shards;
+			for (size_t i = 0; i < TreeNum; i++) {
+				result[i].AvgSearchNs = SearchNs[i].load(std::memory_order_relaxed);
+			}
+			return result;
+		}
+		/*
+		重新分配所有条目并重建所有的树，会等待进行中的搜索结束，期间不能搜索，开销和重新插入全部数据相当
+		条目的开销是后缀数乘以它所在的树实测的每个后缀的搜索耗时，树里的字符越难匹配，其中的条目就越"重"
+		按开销从大到小依次分给当前总开销最小的树，冻结过的树重建后依然是冻结的
+		*/
+		void Rebalance() {
+			WriteGuard guard(*this);
+			std::vector<double> UnitNs(TreeNum, 1.0);
+			bool measured = true;
+			for (size_t i = 0; i < TreeNum; i++) {
+				measured = measured && (shards[i].cost == 0 || SearchNs[i].load(std::memory_order_relaxed) > 0);
+			}
+			for (size_t i = 0; measured && i < TreeNum; i++) {//有树还没被统计过时，只按后缀数分配
+				if (shards[i].cost != 0) {
+					UnitNs[i] = SearchNs[i].load(std::memory_order_relaxed) / static_cast<double>(shards[i].cost);
+				}
+			}
+			struct Entry {
+				std::string str;
+				double cost;
+				size_t tree;
+			};
+			std::vector<Entry> entries;
+			for (size_t i = 0; i < TreeNum; i++) {
+				TreePool[i]->ForEachStr([&entries, &UnitNs, this, i](std::string_view str) {
+					entries.push_back(Entry{ std::string(str), static_cast<double>(EntryCost(str)) * UnitNs[i], 0 });
+				});
+			}
+			std::vector<size_t> order(entries.size());
+			for (size_t i = 0; i < order.size(); i++) {
+				order[i] = i;
+			}
+			std::stable_sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+				return entries[a].cost > entries[b].cost;
+			});
+			std::vector<double> load(TreeNum, 0);
+			for (const size_t i : order) {
+				const size_t index = static_cast<size_t>(std::min_element(load.begin(), load.end()) - load.begin());
+				entries[i].tree = index;
+				load[index] += entries[i].cost;
+			}
+			//每棵树内保持原来的插入顺序
+			std::vector<std::vector<std::string_view>> keywords(TreeNum);
+			for (const Entry& e : entries) {
+				keywords[e.tree].push_back(e.str);
+			}
+			for (size_t i = 0; i < TreeNum; i++) {
+				const bool frozen = TreePool[i]->IsFrozen();
+				auto tree = std::make_unique<TreeSearcher>(logic, context);
+				tree->SetStatsCollector(collector);
+				tree->PutBatch(keywords[i], pool);
+				if (frozen) {
+					tree->Freeze();
+				}
+				TreePool[i] = std::move(tree);
+				shards[i] = ShardStats{};
+				for (const std::string_view& str : keywords[i]) {
+					shards[i].entries++;
+					shards[i].cost += EntryCost(str);
+				}
+				SearchNs[i].store(0, std::memory_order_relaxed);
+			}
+			for (auto& ctx : contexts) {//旧的上下文绑定的是旧的树
+				ctx.reset();
+			}
+		}
+
 		//单位是字节
 		void StrPoolReserve(size_t index, size_t _Newcapacity) {
+			WriteGuard guard(*this);
 			TreePool.at(index)->StrPoolReserve(_Newcapacity);
 		}
 
 		void ClearFreeList() {
+			WriteGuard guard(*this);
 			for (const auto& v : TreePool) {
 				v->ClearFreeList();
 			}
 		}
 
 		void ShrinkToFit() {
+			WriteGuard guard(*this);
 			for (const auto& v : TreePool) {
 				v->ShrinkToFit();
 			}
 		}
 
+		void Freeze() {//冻结所有树，之后不能再put
+			WriteGuard guard(*this);
+			for (const auto& v : TreePool) {
+				v->Freeze();
+			}
+		}
+		//每棵树的每次搜索各自作为一条记录交给collector，见TreeSearcher::SetStatsCollector
+		void SetStatsCollector(std::shared_ptr<SearchStatsCollector> collector) {
+			WriteGuard guard(*this);
+			this->collector = collector;
+			for (const auto& v : TreePool) {
+				v->SetStatsCollector(collector);
+			}
+		}
+
 		PinIn& GetPinIn() noexcept {
 			return *context;
 		}
@@ -98,54 +249,237 @@ namespace PinInCpp {
 		}
 	private:
 		void init(Logic logic) {
-			context->PreNullPinyinIdCache();
+			this->logic = logic;
+			shards.resize(TreeNum);
+			SearchNs = std::make_unique<std::atomic<double>[]>(TreeNum);
 			ticket = context->ticket([this]() {
-				ClearResultSet = true;
+				for (const auto& v : TreePool) {
+					v->refresh();
+				}
 			});
-
-			ThreadPool.reserve(TreeNum);
 			TreePool.reserve(TreeNum);
 			for (size_t i = 0; i < TreeNum; i++) {
 				TreePool.push_back(std::make_unique<TreeSearcher>(logic, context));
-				ThreadPool.emplace_back([this, i]() {
-					while (true) {
-						// 1. 等待开始信号，同时也是上一轮的结束点
-						barrier.arrive_and_wait();
-						if (StopFlag) {//收到结束信号就退出循环
-							break;
+			}
+			contexts.resize(pool.size() * TreeNum);
+			DoneThread = std::thread([this]() {
+				DoneLoop();
+			});
+		}
+
+		/*
+		搜索和修改之间的读写闸门，用计数实现而不是std::shared_mutex，因为异步搜索是在最后一个完成的工作线程上离开闸门的
+		搜索进入闸门时如果发现PinIn的配置变了，就等进行中的搜索结束后先刷新所有的树
+		*/
+		void EnterRead() {
+			std::unique_lock<std::mutex> lk(GateMtx);
+			while (true) {
+				GateCv.wait(lk, [this]() {
+					return !writing;
+				});
+				if (!ticket->stale()) {
+					break;
+				}
+				writing = true;
+				GateCv.wait(lk, [this]() {
+					return readers == 0;
+				});
+				ticket->renew();
+				writing = false;
+				GateCv.notify_all();
+			}
+			readers++;
+		}
+		void LeaveRead() {
+			std::lock_guard<std::mutex> lk(GateMtx);
+			if (--readers == 0) {
+				GateCv.notify_all();
+			}
+		}
+		class ReadGuard {
+		public:
+			ReadGuard(ParallelSearch& p) :p{ p } {
+				p.EnterRead();
+			}
+			~ReadGuard() {
+				p.LeaveRead();
+			}
+		private:
+			ParallelSearch& p;
+		};
+		class WriteGuard {
+		public:
+			WriteGuard(ParallelSearch& p) :p{ p } {
+				std::unique_lock<std::mutex> lk(p.GateMtx);
+				p.GateCv.wait(lk, [&p]() {
+					return !p.writing;
+				});
+				p.writing = true;//先挡住新的搜索，避免修改一直等不到机会
+				p.GateCv.wait(lk, [&p]() {
+					return p.readers == 0;
+				});
+			}
+			~WriteGuard() {
+				std::lock_guard<std::mutex> lk(p.GateMtx);
+				p.writing = false;
+				p.GateCv.notify_all();
+			}
+		private:
+			ParallelSearch& p;
+		};
+
+		//在工作线程里搜索第i棵树，每个工作线程对每棵树有自己的查询上下文，第一次用到时创建
+		void SearchTree(size_t i, const std::string_view& str, std::vector<std::string_view>& out) {
+			std::unique_ptr<TreeSearcher::SearchContext>& ctx = contexts[pool.WorkerIndex() * TreeNum + i];
+			if (ctx == nullptr) {
+				ctx = std::make_unique<TreeSearcher::SearchContext>(*TreePool[i]);
+			}
+			out.clear();
+			const auto start = std::chrono::steady_clock::now();
+			TreePool[i]->ExecuteSearchStream(*ctx, str, [&out](PoolIndex, std::string_view s) {
+				out.push_back(s);
+				return true;
+			});
+			const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			//只是统计值，并发搜索同一棵树时偶尔丢掉一次更新无所谓
+			const double old = SearchNs[i].load(std::memory_order_relaxed);
+			SearchNs[i].store(old == 0 ? ns : old * 0.9 + ns * 0.1, std::memory_order_relaxed);
+		}
+		size_t EntryCost(const std::string_view& str)const noexcept {//插入时产生的后缀数
+			return logic == Logic::CONTAIN ? UTF8StringPool::CountChars(str) : 1;
+		}
+		std::vector<std::vector<std::string_view>> CommonSearch(const std::string_view& str) {//调用方需要持有读闸门
+			std::vector<std::vector<std::string_view>> ResultSet(TreeNum);
+			WorkStealingPool::TaskGroup group;
+			for (size_t i = 0; i < TreeNum; i++) {
+				pool.submit(group, [this, i, &str, &ResultSet]() {
+					SearchTree(i, str, ResultSet[i]);
+				});
+			}
+			pool.wait(group);
+			return ResultSet;
+		}
+		struct AsyncQuery {//异步搜索的共享状态，最后一个完成的任务负责收尾
+			std::string str;
+			std::vector<std::vector<std::string_view>> ResultSet;
+			std::atomic<size_t> remaining;
+			std::mutex mtx;
+			std::exception_ptr error;
+			SearchCallback done;
+		};
+		void CommonAsync(const std::string_view& str, SearchCallback done) {
+			auto query = std::make_shared<AsyncQuery>();
+			query->str = str;
+			query->ResultSet.resize(TreeNum);
+			query->remaining = TreeNum;
+			query->done = std::move(done);
+			{
+				std::lock_guard<std::mutex> lk(DoneMtx);
+				AsyncPending++;
+			}
+			EnterRead();
+			for (size_t i = 0; i < TreeNum; i++) {
+				pool.post([this, i, query]() {
+					try {
+						SearchTree(i, query->str, query->ResultSet[i]);
+					}
+					catch (...) {
+						std::lock_guard<std::mutex> lk(query->mtx);
+						if (!query->error) {
+							query->error = std::current_exception();
 						}
-						// 2. 执行任务，并放入结果集数组
-						ResultSet[i] = TreePool[i]->ExecuteSearchView(searchStr);
-						// 3. 任务完成，到达屏障等待其他线程
-						barrier.arrive_and_wait();
+					}
+					if (--query->remaining == 0) {
+						FinishAsync(*query);
 					}
 				});
 			}
 		}
-		void CommonSearch(const std::string_view& str) {//只需要一个线程执行这个函数即可并发搜索，不要用多个线程执行此函数
-			ticket->renew();
-			if (str != searchStr || ClearResultSet) {//如果是新搜索项或者需要清空结果集时，唤醒线程执行多线程搜索逻辑
-				ClearResultSet = false;
-				ResultSet.resize(TreeNum);//清空并留下空余数组，以方便多线程的时候插入数据
-				context->PreCacheString(str);//预热
-				searchStr = str;
-				//发出信号唤醒线程
-				barrier.arrive_and_wait();
-				//等待线程执行完成
-				barrier.arrive_and_wait();
+		void FinishAsync(AsyncQuery& query) {
+			std::vector<std::string> result;
+			std::exception_ptr error = query.error;
+			if (!error) {
+				try {
+					result.reserve(ResultCount(query.ResultSet));
+					for (const auto& vec : query.ResultSet) {
+						for (const auto& str : vec) {
+							result.push_back(std::string(str));
+						}
+					}
+				}
+				catch (...) {
+					error = std::current_exception();
+					result.clear();
+				}
+			}
+			LeaveRead();//结果已经复制出来了，可以离开闸门
+			{
+				/*
+				done不能在工作线程里调用：done里的put会等待其他异步搜索离开闸门，
+				而只有一个工作线程时，那些搜索的任务排在这个线程的队列里，永远等不到执行
+				*/
+				std::lock_guard<std::mutex> lk(DoneMtx);
+				completions.push_back(Completion{ std::move(query.done), std::move(result), error });
 			}
+			DoneCv.notify_all();
 		}
+		void DoneLoop() {//回调线程，DoneStop之前AsyncPending已经归零，队列里不会剩下回调
+			std::unique_lock<std::mutex> lk(DoneMtx);
+			while (true) {
+				DoneCv.wait(lk, [this]() {
+					return DoneStop || !completions.empty();
+				});
+				if (completions.empty()) {
+					return;
+				}
+				Completion c = std::move(completions.front());
+				completions.pop_front();
+				lk.unlock();
+				try {
+					c.done(std::move(c.result), c.error);
+				}
+				catch (...) {}//回调抛出的异常没有人可以接收
+				c = Completion{};//在锁外销毁done捕获的状态
+				lk.lock();
+				if (--AsyncPending == 0) {
+					DoneCv.notify_all();
+				}
+			}
+		}
+		static size_t ResultCount(const std::vector<std::vector<std::string_view>>& ResultSet)noexcept {
+			size_t count = 0;
+			for (const auto& vec : ResultSet) {
+				count += vec.size();
+			}
+			return count;
+		}
+
 		std::shared_ptr<PinIn> context;//共享状态
-		std::vector<std::thread> ThreadPool;//线程池
 		std::vector<std::unique_ptr<TreeSearcher>> TreePool;//树池
-		std::vector<std::vector<std::string_view>> ResultSet;//用一个数组管理应该插入的数据
+		std::vector<std::unique_ptr<TreeSearcher::SearchContext>> contexts;//工作线程数 * 树的数量
 		std::unique_ptr<PinIn::Ticket> ticket;
-		std::string searchStr;
 		const size_t TreeNum;
-		size_t NextIndex = 0;
-		bool ClearResultSet = false;
+		Logic logic;
+		std::vector<ShardStats> shards;
+		std::unique_ptr<std::atomic<double>[]> SearchNs;//各棵树搜索耗时的移动平均，单位纳秒
+		std::shared_ptr<SearchStatsCollector> collector;//Rebalance重建的树也要接上
+
+		std::mutex GateMtx;
+		std::condition_variable GateCv;
+		size_t readers = 0;
+		bool writing = false;
 
-		std::atomic<bool> StopFlag = false;
-		std::barrier<> barrier;
+		struct Completion {//等待回调线程调用的done
+			SearchCallback done;
+			std::vector<std::string> result;
+			std::exception_ptr error;
+		};
+		std::mutex DoneMtx;
+		std::condition_variable DoneCv;//回调队列有新回调、AsyncPending归零、DoneStop都用它通知
+		std::deque<Completion> completions;
+		size_t AsyncPending = 0;//已经发起但done还没有返回的异步搜索数
+		bool DoneStop = false;
+		std::thread DoneThread;
+		WorkStealingPool pool;//最后声明，最先析构，工作线程退出之后才销毁树和上下文
 	};
 }
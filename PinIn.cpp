@@ -1,4 +1,10 @@
 #include "PinIn.h"
+#include "SearchStats.h"
+#include <bit>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
 
 namespace PinInCpp {
 	//函数定义
@@ -125,7 +131,7 @@ namespace PinInCpp {
 		while (FixedStrs[i] != ',' && FixedStrs[i] != '\0') {
 			i++;
 		}
-		return std::string_view(FixedStrs.get() + start, i - start);
+		return std::string_view(FixedStrs + start, i - start);
 	}
 
 	std::vector<std::string_view> PinIn::CharPool::getPinyinViewVec(size_t i, bool hasTone)const {
@@ -138,7 +144,7 @@ namespace PinInCpp {
 		char tempChar = FixedStrs[i];//局部拷贝，避免多次访问
 		while (tempChar) {//结尾符就退出
 			if (tempChar == ',') {//不保存这个，压入下一个空字符串，移动cursor
-				result.emplace_back(std::string_view(FixedStrs.get() + StrStart, i - StrStart - SubCharSize));//存储指针的只读数据
+				result.emplace_back(std::string_view(FixedStrs + StrStart, i - StrStart - SubCharSize));//存储指针的只读数据
 				cursor++;
 				StrStart = i + 1;//记录下一个字符串的开头
 			}
@@ -146,7 +152,7 @@ namespace PinInCpp {
 			tempChar = FixedStrs[i];//自增完成后再取下一个字符
 		}
 		//保存最后一个
-		result.emplace_back(std::string_view(FixedStrs.get() + StrStart, i - StrStart - SubCharSize));//存储指针的只读数据
+		result.emplace_back(std::string_view(FixedStrs + StrStart, i - StrStart - SubCharSize));//存储指针的只读数据
 		return result;
 	}
 
@@ -203,43 +209,222 @@ namespace PinInCpp {
 			if (pinyinId != NullPinyinId) {
 				pool.putChar(currentTone + '0');//+48就是对应ASCII字符 追加到末尾，这是最后一个的
 				pool.putEnd();//结尾分隔
-				data.insert_or_assign(UnicodeToUtf8(KeyInt), pinyinId);//设置
+				data.put(static_cast<char32_t>(KeyInt), pinyinId);//设置
 			}
 			break;//退出这次循环，读取下一行
 		}
 	}
 
+	/*
+	二进制字典格式，所有整数均为本机字节序，通过endian字段拒绝字节序不一致的文件
+	[BinaryHeader][CharPool的字节][填充到8字节对齐][CharTable一级表][填充到8字节对齐][CharTable二级表]
+	*/
+	static constexpr char BinaryMagic[8] = { 'P', 'I', 'N', 'I', 'N', 'D', 'I', 'C' };
+	static constexpr uint32_t BinaryVersion = 2;
+	static constexpr uint32_t BinaryEndian = 0x01020304;
+
+	struct BinaryHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t endian;
+		uint64_t PoolOffset;
+		uint64_t PoolSize;
+		uint64_t IndexOffset;
+		uint64_t IndexSize;//元素数量，不是字节数，下同
+		uint64_t PagesOffset;
+		uint64_t PagesSize;
+	};
+
+	static size_t AlignTo8(size_t i) noexcept {
+		return (i + 7) & ~static_cast<size_t>(7);
+	}
+
+	bool PinIn::IsBinaryDictionary(const char* input_data, size_t size)noexcept {
+		return size >= sizeof(BinaryMagic) && memcmp(input_data, BinaryMagic, sizeof(BinaryMagic)) == 0;
+	}
+
+	void PinIn::BinaryLoader(const char* input_data, size_t size, bool copy) {
+		if (size < sizeof(BinaryHeader)) {
+			throw PinyinDictionaryInvalid();
+		}
+		BinaryHeader header;
+		memcpy(&header, input_data, sizeof(BinaryHeader));
+		if (header.version != BinaryVersion || header.endian != BinaryEndian) {
+			throw PinyinDictionaryInvalid();
+		}
+		//边界检查，拒绝截断或者损坏的文件
+		if (header.PoolOffset > size || header.PoolSize > size - header.PoolOffset
+			|| header.PoolSize == 0 || input_data[header.PoolOffset + header.PoolSize - 1] != '\0'
+			|| header.IndexSize != CharTable::IndexSize || header.IndexOffset % alignof(uint16_t) != 0
+			|| header.IndexOffset > size || header.IndexSize > (size - header.IndexOffset) / sizeof(uint16_t)
+			|| header.PagesSize == 0 || header.PagesSize % CharTable::PageSize != 0 || header.PagesOffset % alignof(uint32_t) != 0
+			|| header.PagesOffset > size || header.PagesSize > (size - header.PagesOffset) / sizeof(uint32_t)) {
+			throw PinyinDictionaryInvalid();
+		}
+		const char* PoolData = input_data + header.PoolOffset;
+		const uint16_t* IndexData = reinterpret_cast<const uint16_t*>(input_data + header.IndexOffset);
+		const uint32_t* PagesData = reinterpret_cast<const uint32_t*>(input_data + header.PagesOffset);
+		//页号和id越界会导致后续访问越界，这里一次性检查掉
+		const size_t PageNum = static_cast<size_t>(header.PagesSize / CharTable::PageSize);
+		for (size_t i = 0; i < header.IndexSize; i++) {
+			if (IndexData[i] >= PageNum) {
+				throw PinyinDictionaryInvalid();
+			}
+		}
+		for (size_t i = 0; i < header.PagesSize; i++) {
+			if (PagesData[i] != CharTable::NullId && PagesData[i] >= header.PoolSize) {
+				throw PinyinDictionaryInvalid();
+			}
+		}
+		if (copy) {
+			pool.put(std::string_view(PoolData, static_cast<size_t>(header.PoolSize)));
+			pool.Fixed();
+			for (size_t i = 0; i < header.IndexSize; i++) {
+				if (IndexData[i] == 0) {
+					continue;
+				}
+				const uint32_t* page = PagesData + static_cast<size_t>(IndexData[i]) * CharTable::PageSize;
+				for (uint32_t j = 0; j < CharTable::PageSize; j++) {
+					if (page[j] != CharTable::NullId) {
+						data.put(static_cast<char32_t>((i << CharTable::PageBits) | j), page[j]);
+					}
+				}
+			}
+			data.Fixed();
+		}
+		else {
+			pool.Attach(PoolData, static_cast<size_t>(header.PoolSize));
+			data.Attach(IndexData, PagesData, static_cast<size_t>(header.PagesSize));
+		}
+	}
+
+	void PinIn::TextParser(const char* input_data, size_t size) {
+		size_t last_cursor = 0;
+		for (size_t i = 0; i < size; i++) {
+			if (input_data[i] == '\n') {//按行解析
+				LineParser(std::string_view(input_data + last_cursor, i - last_cursor));
+				last_cursor = i + 1;//跳过换行
+			}
+		}
+		LineParser(std::string_view(input_data + last_cursor, size - last_cursor));//解析最后一行
+		pool.Fixed();
+		data.Fixed();
+	}
+
 	//PinIn类
 	PinIn::PinIn(const std::string_view& path) {
-		std::fstream fs = std::fstream(std::string(path), std::ios::in);
-		if (!fs.is_open()) {//未成功打开 
+		std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>(path);
+		if (!file->IsOpen()) {//未成功打开 
 			//std::cerr << "file did not open successfully(StrToPinyin)\n";
 			throw PinyinFileNotOpen();
 		}
-		//开始读取
-		std::string str;
-		while (std::getline(fs, str)) {
-			LineParser(str);
+		if (IsBinaryDictionary(file->data(), file->size())) {
+			BinaryLoader(file->data(), file->size(), false);
+			mapping = std::move(file);//二进制字典原地使用，映射需要跟随PinIn的生命周期
 		}
-		pool.Fixed();
+		else {//文本字典解析完成后映射就没用了，随file析构
+			TextParser(file->data(), file->size());
+		}
+		BuildSyllables();
+		SetCharCache(true);//缓存槽位依赖字符表的大小，所以放在加载完成后
 	}
 
 	PinIn::PinIn(const std::vector<char>& input_data) {
-		//开始读取
-		std::string_view str;
-		size_t last_cursor = 0;
-		for (size_t i = 0; i < input_data.size(); i++) {
-			if (input_data[i] == '\n') {//按行解析
-				LineParser(std::string_view(input_data.data() + last_cursor, i - last_cursor));
-				last_cursor = i + 1;//跳过换行
+		if (IsBinaryDictionary(input_data.data(), input_data.size())) {
+			BinaryLoader(input_data.data(), input_data.size(), true);//外部数据的生命周期不归我们管，需要拷贝
+		}
+		else {
+			TextParser(input_data.data(), input_data.size());
+		}
+		BuildSyllables();
+		SetCharCache(true);
+	}
+
+	void PinIn::BuildSyllables() {
+		//按页表里实际引用的位置收集，而不是从头扫描pool，二进制字典里的id不一定指向一条记录的开头，这样每个字符的读音都保证在表里
+		std::vector<size_t> positions;//每个音节第一次出现的位置
+		for (size_t i = 0; i < data.PagesSize(); i++) {
+			const size_t id = data.at(i);
+			if (id == NullPinyinId) {
+				continue;
 			}
+			pool.ForEachPinyin(id, [this, &positions](std::string_view str, size_t pos) {
+				if (SyllableIndex.try_emplace(str, static_cast<uint32_t>(positions.size())).second) {
+					positions.push_back(pos);
+				}
+			});
 		}
-		LineParser(std::string_view(input_data.data() + last_cursor, input_data.size() - last_cursor));//解析最后一行
-		pool.Fixed();
+		syllables.reserve(positions.size());//先收集完再构建，避免扩容时整体拷贝音素
+		for (size_t i = 0; i < positions.size(); i++) {
+			syllables.push_back(Pinyin(*this, positions[i], static_cast<uint32_t>(i)));
+		}
+	}
+
+	void PinIn::SaveBinary(const std::string_view& path)const {
+		BinaryHeader header;
+		memcpy(header.magic, BinaryMagic, sizeof(BinaryMagic));
+		header.version = BinaryVersion;
+		header.endian = BinaryEndian;
+		header.PoolOffset = sizeof(BinaryHeader);
+		header.PoolSize = pool.size();
+		header.IndexOffset = AlignTo8(sizeof(BinaryHeader) + pool.size());
+		header.IndexSize = CharTable::IndexSize;
+		header.PagesOffset = AlignTo8(header.IndexOffset + CharTable::IndexSize * sizeof(uint16_t));
+		header.PagesSize = data.PagesSize();
+
+		std::fstream fs = std::fstream(std::string(path), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!fs.is_open()) {
+			throw PinyinFileNotOpen();
+		}
+		const char padding[8] = {};
+		fs.write(reinterpret_cast<const char*>(&header), sizeof(BinaryHeader));
+		fs.write(pool.data(), pool.size());
+		fs.write(padding, header.IndexOffset - header.PoolOffset - header.PoolSize);
+		fs.write(reinterpret_cast<const char*>(data.IndexData()), CharTable::IndexSize * sizeof(uint16_t));
+		fs.write(padding, header.PagesOffset - header.IndexOffset - CharTable::IndexSize * sizeof(uint16_t));
+		fs.write(reinterpret_cast<const char*>(data.PagesData()), data.PagesSize() * sizeof(uint32_t));
+		if (!fs.good()) {
+			throw PinyinFileNotOpen();
+		}
+	}
+
+	//FNV-1a 64位
+	static uint64_t Fnv1a(uint64_t hash, const void* input_data, size_t size) noexcept {
+		const unsigned char* p = static_cast<const unsigned char*>(input_data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= p[i];
+			hash *= 0x100000001B3ULL;
+		}
+		return hash;
+	}
+
+	PinIn::MemoryReport PinIn::MemoryUsage()const {
+		MemoryReport result;
+		result.CharPool = pool.MemoryUsage();
+		result.data = data.MemoryUsage();
+		result.syllables = HeapBytes(syllables) + HeapBytes(SyllableIndex);
+		for (const Pinyin& p : syllables) {
+			result.syllables += p.MemoryUsage();
+		}
+		if (CharCache != nullptr) {
+			result.CharCache = sizeof(CharCacheTable) + CharCache->MemoryUsage();
+		}
+		if (mapping != nullptr) {
+			result.data += sizeof(MappedFile);
+			result.mapped = mapping->size();
+		}
+		return result;
+	}
+
+	uint64_t PinIn::DictionaryFingerprint()const noexcept {
+		uint64_t hash = 0xCBF29CE484222325ULL;
+		hash = Fnv1a(hash, pool.data(), pool.size());
+		hash = Fnv1a(hash, data.IndexData(), CharTable::IndexSize * sizeof(uint16_t));
+		return Fnv1a(hash, data.PagesData(), data.PagesSize() * sizeof(uint32_t));
 	}
 
 	bool PinIn::HasPinyin(const std::string_view& str)const noexcept {
-		return static_cast<bool>(data.count(FourCCToU32(str)));
+		return GetPinyinId(FourCCToU32(str)) != NullPinyinId;
 	}
 
 	std::vector<std::string> PinIn::GetPinyinById(const size_t id, bool hasTone)const {
@@ -267,25 +452,25 @@ namespace PinInCpp {
 	}
 
 	std::vector<std::string> PinIn::GetPinyin(const std::string_view& str, bool hasTone)const {
-		auto it = data.find(FourCCToU32(str));
-		if (it == data.end()) {//没数据返回由输入字符串组成的向量
+		size_t id = GetPinyinId(str);
+		if (id == NullPinyinId) {//没数据返回由输入字符串组成的向量
 			return std::vector<std::string>{std::string(str)};
 		}
 		if (hasTone) {//如果需要音调就直接返回
-			return pool.getPinyinVec(it->second);//直接返回这个方法返回的值
+			return pool.getPinyinVec(id);//直接返回这个方法返回的值
 		}
-		return DeleteTone<std::string>(this, it->second);
+		return DeleteTone<std::string>(this, id);
 	}
 
 	std::vector<std::string_view> PinIn::GetPinyinView(const std::string_view& str, bool hasTone)const {
-		auto it = data.find(FourCCToU32(str));
-		if (it == data.end()) {//没数据返回由输入字符串组成的向量
+		size_t id = GetPinyinId(str);
+		if (id == NullPinyinId) {//没数据返回由输入字符串组成的向量
 			return std::vector<std::string_view>{str};
 		}
 		if (hasTone) {//有声调
-			return pool.getPinyinViewVec(it->second, true);//直接返回这个方法返回的值
+			return pool.getPinyinViewVec(id, true);//直接返回这个方法返回的值
 		}
-		return DeleteTone<std::string_view>(this, it->second);
+		return DeleteTone<std::string_view>(this, id);
 	}
 
 	std::vector<std::vector<std::string>> PinIn::GetPinyinList(const std::string_view& str, bool hasTone)const {
@@ -310,18 +495,14 @@ namespace PinInCpp {
 
 	PinIn::Character* PinIn::GetCharCachePtr(const std::string_view& str) {
 		if (CharCache) {
-			size_t id = GetPinyinId(str);
-			std::unordered_map<size_t, std::unique_ptr<Character>>& cache = CharCache.value();
-			auto it = cache.find(id);
-			if (it == cache.end()) {//缓存不存在时
-				std::unique_ptr<Character> ptr = std::unique_ptr<Character>(new Character(*this, str, id));
-				Character* result = ptr.get();
-				cache.insert_or_assign(id, std::move(ptr));
-				return result;
-			}
-			else {
-				return it->second.get();//缓存存在时
+			size_t slot = data.slot(FourCCToU32(str));
+			size_t id = data.at(slot);
+			slot = id == NullPinyinId ? CharCache->NullSlot() : slot;
+			Character* result = CharCache->get(slot);
+			if (result == nullptr) {//缓存不存在时构建一个，和其他线程竞争插入
+				result = CharCache->insert(slot, std::unique_ptr<Character>(new Character(*this, str, id)));
 			}
+			return result;
 		}
 		else {
 			return nullptr;
@@ -330,20 +511,16 @@ namespace PinInCpp {
 
 	PinIn::Character* PinIn::GetCharCachePtr(const uint32_t fourCC) {
 		if (CharCache) {
-			size_t id = GetPinyinId(fourCC);
-			std::unordered_map<size_t, std::unique_ptr<Character>>& cache = CharCache.value();
-			auto it = cache.find(id);
-			if (it == cache.end()) {//缓存不存在时
+			size_t slot = data.slot(fourCC);
+			size_t id = data.at(slot);
+			slot = id == NullPinyinId ? CharCache->NullSlot() : slot;
+			Character* result = CharCache->get(slot);
+			if (result == nullptr) {//缓存不存在时构建一个，和其他线程竞争插入
 				char buf[5];
 				U32FourCCToCharBuf(buf, fourCC);
-				std::unique_ptr<Character> ptr = std::unique_ptr<Character>(new Character(*this, buf, id));
-				Character* result = ptr.get();
-				cache.insert_or_assign(id, std::move(ptr));
-				return result;
-			}
-			else {
-				return it->second.get();//缓存存在时
+				result = CharCache->insert(slot, std::unique_ptr<Character>(new Character(*this, buf, id)));
 			}
+			return result;
 		}
 		else {
 			return nullptr;
@@ -372,10 +549,8 @@ namespace PinInCpp {
 		ctx.fU2V = fU2V;
 		ctx.fFirstChar = fFirstChar;
 
-		if (ctx.CharCache) {
-			for (const auto& v : ctx.CharCache.value()) {
-				v.second->reload();
-			}
+		for (Pinyin& p : ctx.syllables) {//缓存的和临时构建的Character都只持有音节序号，重载音节表就够了
+			p.reload();
 		}
 
 		ctx.modification++;
@@ -400,7 +575,8 @@ namespace PinInCpp {
 		return false;
 	}
 
-	IndexSet PinIn::Phoneme::match(const Utf8String& source, IndexSet idx, size_t start, bool partial)const noexcept {
+	template<typename Src>
+	IndexSet PinIn::Phoneme::MatchIdx(const Src& source, IndexSet idx, size_t start, bool partial)const noexcept {
 		if (empty()) {
 			return idx;
 		}
@@ -415,7 +591,101 @@ namespace PinInCpp {
 		return result;
 	}
 
+	IndexSet PinIn::Phoneme::match(const Utf8String& source, IndexSet idx, size_t start, bool partial)const noexcept {
+		return MatchIdx(source, idx, start, partial);
+	}
+
+	IndexSet PinIn::Phoneme::match(const AsciiQuery& source, IndexSet idx, size_t start, bool partial)const noexcept {
+		return MatchIdx(source, idx, start, partial);
+	}
+
+	//计算4个通道各自和q的公共前缀字节数，每个通道最多8
+	static void LanePrefix(uint64_t q, const uint64_t* lane, uint32_t prefix[4]) noexcept {
+#if defined(__AVX2__)
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_set1_epi64x(static_cast<long long>(q)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lane)))));
+		for (uint32_t i = 0; i < 4; i++) {
+			prefix[i] = static_cast<uint32_t>(std::countr_one(static_cast<uint8_t>(mask >> (i * 8))));
+		}
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		const __m128i qq = _mm_set1_epi64x(static_cast<long long>(q));
+		for (uint32_t i = 0; i < 4; i += 2) {
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(qq, _mm_loadu_si128(reinterpret_cast<const __m128i*>(lane + i)))));
+			prefix[i] = static_cast<uint32_t>(std::countr_one(static_cast<uint8_t>(mask)));
+			prefix[i + 1] = static_cast<uint32_t>(std::countr_one(static_cast<uint8_t>(mask >> 8)));
+		}
+#else
+		for (uint32_t i = 0; i < 4; i++) {//异或后第一个非0字节就是第一个不同的字符
+			uint64_t x = q ^ lane[i];
+			if constexpr (std::endian::native == std::endian::little) {
+				prefix[i] = x == 0 ? 8 : static_cast<uint32_t>(std::countr_zero(x)) / 8;
+			}
+			else {
+				prefix[i] = x == 0 ? 8 : static_cast<uint32_t>(std::countl_zero(x)) / 8;
+			}
+		}
+#endif
+	}
+
+	IndexSet PinIn::Phoneme::match(const AsciiQuery& source, size_t start, bool partial)const noexcept {
+		PININCPP_STAT(PhonemeMatches++);
+		IndexSet result = IndexSet::Init();
+		if (empty()) {
+			return result;
+		}
+		const size_t remain = source.size() - start;
+		if (lanes.empty()) {//没有打包的，逐字节比较
+			for (const auto& str : strs) {
+				size_t len = std::min(remain, str.size());
+				size_t size = 0;
+				while (size < len && source[start + size] == str[size]) {
+					size++;
+				}
+				if (partial && size == remain) {
+					result.set(static_cast<uint32_t>(size));  // ending match
+				}
+				else if (size == str.size()) {
+					result.set(static_cast<uint32_t>(size)); // full match
+				}
+			}
+			return result;
+		}
+		uint64_t q;
+		memcpy(&q, source.data() + start, sizeof(q));//AsciiQuery保证了末尾的填充，不会越界
+		uint32_t prefix[4];
+		for (size_t i = 0; i < strs.size(); i += 4) {
+			LanePrefix(q, lanes.data() + i, prefix);
+			const size_t end = std::min<size_t>(strs.size() - i, 4);
+			for (size_t j = 0; j < end; j++) {
+				const size_t AtomSize = strs[i + j].size();
+				const size_t size = std::min<size_t>({ prefix[j], AtomSize, remain });
+				if (partial && size == remain) {
+					result.set(static_cast<uint32_t>(size));  // ending match
+				}
+				else if (size == AtomSize) {
+					result.set(static_cast<uint32_t>(size)); // full match
+				}
+			}
+		}
+		return result;
+	}
+
+	void PinIn::Phoneme::pack() {
+		lanes.clear();
+		for (const auto& str : strs) {
+			if (str.size() > sizeof(uint64_t)) {
+				lanes.clear();
+				return;
+			}
+			uint64_t lane = 0;
+			memcpy(&lane, str.data(), str.size());
+			lanes.push_back(lane);
+		}
+		lanes.resize((strs.size() + 3) / 4 * 4, 0);
+	}
+
 	IndexSet PinIn::Phoneme::match(const Utf8String& source, size_t start, bool partial)const noexcept {
+		PININCPP_STAT(PhonemeMatches++);
 		IndexSet result = IndexSet::Init();
 		if (empty()) {
 			return result;
@@ -531,18 +801,17 @@ namespace PinInCpp {
 	void PinIn::Phoneme::reload() {
 		strs.clear();//应该前置，因为是在重载，非法的话就当然置空了
 		if (src.empty()) {//没数据？非法的吧！，不过就直接结束了也算一种处理了
-			return;
 		}
-		if (src.size() == 1 && src[0] >= '0' && src[0] <= '4') {
-			strs.emplace_back(src); //声调就是它自己，直接处理完毕返回！
-			return;
+		else if (src.size() == 1 && src[0] >= '0' && src[0] <= '4') {
+			strs.emplace_back(src); //声调就是它自己，直接处理完毕！
 		}
-		if (ctx.keyboard.GetHasFuuzyLocal()) {
+		else if (ctx.keyboard.GetHasFuuzyLocal()) {
 			reloadHasMap();//非标准音素，部分纯逻辑加查表实现
 		}
 		else {
 			reloadNoMap();//标准音素，纯逻辑实现
 		}
+		pack();
 	}
 
 	void PinIn::Pinyin::reload() {
@@ -555,7 +824,16 @@ namespace PinInCpp {
 		}
 	}
 
-	IndexSet PinIn::Pinyin::match(const Utf8String& str, size_t start, bool partial)const noexcept {
+	static char FirstByte(const Utf8String& str, size_t i) noexcept {
+		return str[i][0];
+	}
+
+	static char FirstByte(const AsciiQuery& str, size_t i) noexcept {
+		return str[i];
+	}
+
+	template<typename Src>
+	IndexSet PinIn::Pinyin::MatchImpl(const Src& str, size_t start, bool partial)const noexcept {
 		IndexSet ret = IndexSet::Init();
 		if (duo) {
 			// in shuangpin we require initial and final both present,
@@ -576,27 +854,33 @@ namespace PinInCpp {
 				ret.merge(active);
 			}
 		}
-		if (sequence && phonemes[0].matchSequence(str[start][0])) {//内部音素都是ASCII范围内的，所以本质上就是在比较ASCII，直接取字符丢进去比较就行
+		if (sequence && phonemes[0].matchSequence(FirstByte(str, start))) {//内部音素都是ASCII范围内的，所以本质上就是在比较ASCII，直接取字符丢进去比较就行
 			ret.set(1);
 		}
 
 		return ret;
 	}
 
+	IndexSet PinIn::Pinyin::match(const Utf8String& str, size_t start, bool partial)const noexcept {
+		return MatchImpl(str, start, partial);
+	}
+
+	IndexSet PinIn::Pinyin::match(const AsciiQuery& str, size_t start, bool partial)const noexcept {
+		return MatchImpl(str, start, partial);
+	}
+
 	PinIn::Character::Character(const PinIn& p, const std::string_view& ch, const size_t id) :ctx{ p }, id{ id }, ch{ ch } {
 		if (id == NullPinyinId) {
 			return;//无效拼音数据
 		}
-		size_t currentId = id;
-		for (const auto& str : p.GetPinyinViewById(id, true)) {//split需要处理带声调的版本
-			pinyin.emplace_back(Pinyin(ctx, currentId));
-			currentId += str.size() + 2;//因为有个分隔符和声调，所以要+2要跳过直到下一个字符串起始
-		}
+		p.pool.ForEachPinyin(id, [this, &p](std::string_view str, size_t) {//音节表在加载时已经收录了页表引用的所有读音
+			syllables.push_back(p.SyllableIndex.find(str)->second);
+		});
 	}
 
 	IndexSet PinIn::Character::match(const Utf8String& u8str, size_t start, bool partial)const noexcept {
 		IndexSet ret = u8str[start] == ch ? IndexSet::ONE : IndexSet::NONE;
-		for (const auto& p : pinyin) {
+		for (const Pinyin& p : GetPinyins()) {
 			ret.merge(p.match(u8str, start, partial));
 		}
 		return ret;
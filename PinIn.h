@@ -5,9 +5,16 @@
 #include <unordered_map>
 #include <set>
 #include <cmath>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
 
 #include "Keyboard.h"
 #include "IndexSet.h"
+#include "MappedFile.h"
+#include "MemoryUsage.h"
 
 namespace PinInCpp {
 	//Unicode码转utf8字符
@@ -66,6 +73,15 @@ namespace PinInCpp {
 		const auto end()const noexcept {
 			return str.end();
 		}
+		size_t MemoryUsage()const noexcept {//堆内存，单位是字节
+			size_t bytes = HeapBytes(str);
+			if constexpr (std::is_same_v<StrType, std::string>) {
+				for (const auto& v : str) {
+					bytes += HeapBytes(v);
+				}
+			}
+			return bytes;
+		}
 	private:
 		static size_t getUTF8CharSize(char c) noexcept {
 			if ((c & 0x80) == 0) { // 0xxxxxxx
@@ -89,24 +105,75 @@ namespace PinInCpp {
 	using Utf8String = UTF8StringTemplate<std::string>;
 	using Utf8StringView = UTF8StringTemplate<std::string_view>;
 
+	//搜索串的ASCII字节视图，每个utf8字符对应一个字节，非ASCII字符用NonAscii占位，所以偏移量和Utf8String的一致
+	//音素原子都是ASCII字符，占位符永远不会匹配，末尾有Padding字节的填充，可以从任意合法的偏移量(包括末尾)安全读取8字节
+	class AsciiQuery {
+	public:
+		static constexpr char NonAscii = static_cast<char>(0x80);
+		static constexpr size_t Padding = 8;
+		AsciiQuery() {
+			buf.assign(Padding, NonAscii);
+		}
+		void assign(const Utf8String& str) {
+			buf.clear();
+			for (const auto& v : str) {
+				buf.push_back(v.size() == 1 ? v[0] : NonAscii);
+			}
+			len = buf.size();
+			buf.append(Padding, NonAscii);
+		}
+		size_t size()const noexcept {
+			return len;
+		}
+		const char* data()const noexcept {
+			return buf.data();
+		}
+		char operator[](size_t i)const noexcept {
+			return buf[i];
+		}
+		size_t MemoryUsage()const noexcept {
+			return HeapBytes(buf);
+		}
+	private:
+		std::string buf;
+		size_t len = 0;
+	};
+
 	class PinyinFileNotOpen : public std::exception {
 	public:
 		virtual const char* what() {
 			return "File not successfully opened";
 		}
 	};
+	class PinyinDictionaryInvalid : public std::exception {//二进制字典的魔数/版本/字节序/长度校验不通过
+	public:
+		virtual const char* what()const noexcept {
+			return "Binary pinyin dictionary is invalid or has an unsupported version";
+		}
+	};
 	static constexpr size_t NullPinyinId = static_cast<size_t>(-1);
 
 	//文件解析策略为：跳过错误行
 	class PinIn {
 	public:
 		class Character;//你应该在这里，因为你是公开接口里返回的对象！(向前声明)
+		//文本字典和SaveBinary生成的二进制字典都可以，按文件头自动识别，二进制字典会被直接映射到内存中原地使用，不做解析
 		PinIn(const std::string_view& path);
-		PinIn(const std::vector<char>& input_data);//数据加载模式
+		PinIn(const std::vector<char>& input_data);//数据加载模式，同样会识别二进制字典，但数据需要拷贝一份
+		//音节表和缓存的字符都引用着这个对象，不能拷贝或移动，需要共享时用智能指针
+		PinIn(const PinIn&) = delete;
+		PinIn& operator=(const PinIn&) = delete;
+		//将当前的拼音数据写成二进制字典，后续用PinIn(path)加载时可以跳过文本解析，多个进程也能共享同一份只读映射
+		void SaveBinary(const std::string_view& path)const;
+		//把文本字典编译为二进制字典
+		static void CompileBinary(const std::string_view& TextPath, const std::string_view& BinaryPath) {
+			PinIn(TextPath).SaveBinary(BinaryPath);
+		}
+		//拼音数据(不含配置)的指纹，同一份字典无论从文本还是二进制加载结果都一样，用于识别过期的持久化索引
+		uint64_t DictionaryFingerprint()const noexcept;
 		//返回的是汉字拼音id，不是单拼音的拼音id
 		size_t GetPinyinId(const uint32_t hanziFourCC)const {
-			auto it = data.find(hanziFourCC);
-			return it == data.end() ? NullPinyinId : it->second;
+			return data.find(hanziFourCC);
 		}
 		//返回的是汉字拼音id，不是单拼音的拼音id
 		size_t GetPinyinId(const std::string_view& hanzi)const {
@@ -129,39 +196,39 @@ namespace PinInCpp {
 			U32FourCCToCharBuf(buf, fourCC);
 			return Character(*this, buf, GetPinyinId(fourCC));
 		}
-		Character* GetCharCachePtr(const std::string_view& str);//缓存关闭时返回空指针，开启时返回有效数据，注意，无效的字符串在缓存存储后再次返回都是第一个访问时的无效的字符串
+		//缓存关闭时返回空指针，开启时返回有效数据，注意，无效的字符串在缓存存储后再次返回都是第一个访问时的无效的字符串
+		//读取是无锁的，首次插入用CAS完成，多个线程(多个共享此PinIn的TreeSearcher)可以同时调用，不需要预热
+		Character* GetCharCachePtr(const std::string_view& str);
 		Character* GetCharCachePtr(const uint32_t fourCC);//同上
 
-		//字符缓存预热，可以用待选项/搜索字符串预热，避免缓存的多线程数据竞争问题，如果是单线程的则不用管
+		//字符缓存预热，缓存本身已经线程安全，这个只是用待选项/搜索字符串提前构建好缓存，把首次构建的开销挪出搜索过程
 		void PreCacheString(const std::string_view& str) {
 			if (!CharCache) {
 				return;
 			}
 			Utf8StringView u8str = str;
-			std::unordered_map<size_t, std::unique_ptr<Character>>& cache = CharCache.value();
 			for (const auto& v : u8str) {
-				size_t id = GetPinyinId(v);
-				if (id != NullPinyinId && !cache.count(id)) {
-					cache.insert_or_assign(id, std::unique_ptr<Character>(new Character(*this, v, id)));
+				if (HasPinyin(v)) {
+					GetCharCachePtr(v);
 				}
 			}
 		}
-		//强制生成一个空拼音id的缓存，配合上面那个api即可实现线程安全
+		//强制生成一个空拼音id的缓存，和上面那个api一样只是预热，不再是线程安全的前提
 		void PreNullPinyinIdCache() {
-			if (!CharCache || CharCache.value().count(NullPinyinId)) {//如果关闭了缓存或者NullPinyinId有值，则不执行
+			if (!CharCache || CharCache->get(CharCache->NullSlot()) != nullptr) {//如果关闭了缓存或者NullPinyinId有值，则不执行
 				return;
 			}
-			std::unordered_map<size_t, std::unique_ptr<Character>>& cache = CharCache.value();
-			cache.insert_or_assign(NullPinyinId, std::unique_ptr<Character>(new Character(*this, "", NullPinyinId)));
+			CharCache->insert(CharCache->NullSlot(), std::unique_ptr<Character>(new Character(*this, "", NullPinyinId)));
 		}
 		bool IsCharCacheEnabled()const noexcept {
-			return CharCache.has_value();
+			return CharCache != nullptr;
 		}
-		void SetCharCache(bool enable) {//默认开启缓存
-			if (enable && !CharCache.has_value()) {//如果启用且没有值的时候
-				CharCache = std::unordered_map<size_t, std::unique_ptr<Character>>();
+		//默认开启缓存，开关缓存和Config::commit一样不是线程安全的，不要在有其他线程搜索时调用
+		void SetCharCache(bool enable) {
+			if (enable && CharCache == nullptr) {//如果启用且没有值的时候
+				CharCache = std::make_unique<CharCacheTable>(data.PagesSize() + 1);
 			}
-			else {//未启用的时候清空
+			else if (!enable) {//未启用的时候清空
 				CharCache.reset();
 			}
 		}
@@ -169,13 +236,32 @@ namespace PinInCpp {
 		bool empty()const noexcept {//返回有效性，真即有效，假即无效
 			return pool.empty();
 		}
+		struct MemoryReport {//单位是字节，按容器容量计算的堆内存，不含PinIn对象本身，无序容器的部分是估算值
+			size_t CharPool = 0;//拼音字符串，映射二进制字典时为0
+			size_t data = 0;//字符到拼音id的页表，映射二进制字典时只剩映射对象本身
+			size_t syllables = 0;//音节表，所有字符共享的Pinyin和它们的音素
+			size_t CharCache = 0;//字符缓存的槽位，以及缓存着的Character和它们的音节序号
+			size_t mapped = 0;//二进制字典的映射，不在堆上，同一个文件的多个进程共享物理页，不计入total
+			size_t total()const noexcept {
+				return CharPool + data + syllables + CharCache;
+			}
+		};
+		//读取缓存是无锁的，可以和搜索同时调用，这时CharCache只是调用时刻的值
+		MemoryReport MemoryUsage()const;
 		bool HasPinyin(const std::string_view& str)const noexcept;
+		//字典里不同的带声调拼音的数量，音节序号的范围是[0, SyllableCount())
+		size_t SyllableCount()const noexcept {
+			return syllables.size();
+		}
 
 		class Ticket {
 		public:
 			Ticket(const PinIn& ctx, const std::function<void()>& fn) : runnable{ fn }, ctx{ ctx } {
 				modification = ctx.modification;
 			}
+			bool stale()const noexcept {//配置在上次renew之后被修改过
+				return modification != ctx.modification;
+			}
 			void renew() {
 				int i = ctx.modification;
 				if (modification != i) {
@@ -229,7 +315,8 @@ namespace PinInCpp {
 			bool fU2V = false;
 			bool fFirstChar = false;
 			//将当前Config对象中的所有设置应用到PinIn上下文中。此方法总会触发数据的更改，无论配置是否实际发生变化，调用者应负责避免不必要的或重复的commit()调用
-			//重载完成后，音素这样的数据的视图不再合法，需要重载(重载字符类即可)，可以用Ticket类注册一个异步操作，在每次执行前检查后按需重载(执行Ticket::renew触发回调函数)
+			//只需要重载音节表，Character只持有音节序号，不需要重载，但之前拿到的Phoneme的引用和原子的视图不再合法
+			//自己缓存了音素的(比如TreeSearcher的音素索引)可以用Ticket类注册一个异步操作，在每次执行前检查后按需重载(执行Ticket::renew触发回调函数)
 			void commit();
 		private:
 			PinIn& ctx;//绑定的拼音上下文
@@ -238,7 +325,7 @@ namespace PinInCpp {
 			return Config(*this);
 		}
 
-		//权责关系:Phoneme->Pinyin->Character->PinIn
+		//权责关系:Phoneme->Pinyin->PinIn，每个带声调的拼音在PinIn的音节表里只有一份，Character只持有音节序号
 		class Element {//基类，确保这些成分都像原始的设计一样，可以被转换为这个基本的类
 		public:
 			virtual ~Element() = default;
@@ -275,12 +362,18 @@ namespace PinInCpp {
 			bool matchSequence(const char c)const noexcept;
 			IndexSet match(const Utf8String& source, IndexSet idx, size_t start, bool partial)const noexcept;
 			IndexSet match(const Utf8String& source, size_t start, bool partial)const noexcept;
+			//搜索用的快速版本，原子打包成8字节的通道后一次比较多个原子(AVX2一次4个，SSE2一次2个，否则用64位整数逐个比较)
+			IndexSet match(const AsciiQuery& source, IndexSet idx, size_t start, bool partial)const noexcept;
+			IndexSet match(const AsciiQuery& source, size_t start, bool partial)const noexcept;
 			const std::vector<std::string_view>& GetAtoms()const noexcept {//获取这个音素的最小成分(原子)，即它表达了什么音素
 				return strs;
 			}
 			const std::string_view& GetSrc()const noexcept {
 				return src;
 			}
+			size_t MemoryUsage()const noexcept {//对象本身以外的堆内存
+				return HeapBytes(strs) + HeapBytes(lanes);
+			}
 		private:
 			friend Pinyin;//由Pinyin类执行构建
 			void reload();//本质上只需要代表好它的对象即可，本质上应该禁用，因为切换时音素本身也有可能会被切换，这时候视图可能是危险的，要确保重载行为在框架内是合理的
@@ -289,10 +382,14 @@ namespace PinInCpp {
 			}
 			void reloadNoMap();//无Local表的纯逻辑处理
 			void reloadHasMap();//有Local表的逻辑查表混合处理
+			void pack();//把原子打包成通道，有原子超过8字节时不打包，走逐字节比较
+			template<typename Src>
+			IndexSet MatchIdx(const Src& source, IndexSet idx, size_t start, bool partial)const noexcept;
 
 			const PinIn& ctx;//直接绑定拼音上下文，方便reload
 			const std::string_view src;
 			std::vector<std::string_view> strs;//真正用于处理的数据
+			std::vector<uint64_t> lanes;//打包后的原子，每个原子一个通道，不足8字节补0，数量补齐到4的倍数
 		};
 		class Pinyin : public Element {
 		public:
@@ -305,17 +402,82 @@ namespace PinInCpp {
 			}
 			void reload();
 			IndexSet match(const Utf8String& str, size_t start, bool partial)const noexcept;
+			IndexSet match(const AsciiQuery& str, size_t start, bool partial)const noexcept;//搜索用的快速版本
+			size_t MemoryUsage()const noexcept {//对象本身以外的堆内存
+				size_t bytes = HeapBytes(phonemes);
+				for (const auto& p : phonemes) {
+					bytes += p.MemoryUsage();
+				}
+				return bytes;
+			}
 			const size_t id;//原始设计也是不变的，轻量级id设计，可用此id直接重载数据，不直接持有拼音字符串视图
+			const uint32_t SyllableId;//在音节表里的序号，从0开始连续，可以直接当数组下标或者哈希的键
 		private:
-			friend Character;//由Character类执行构建
-			Pinyin(const PinIn& p, size_t id) :ctx{ p }, id{ id } {
+			friend PinIn;//由PinIn构建音节表
+			Pinyin(const PinIn& p, size_t id, uint32_t SyllableId) :ctx{ p }, id{ id }, SyllableId{ SyllableId } {
 				reload();
 			}
+			template<typename Src>
+			IndexSet MatchImpl(const Src& str, size_t start, bool partial)const noexcept;
 			const PinIn& ctx;
 			bool duo = false;
 			bool sequence = false;
 			std::vector<Phoneme> phonemes;
 		};
+		//Character的读音列表，按音节序号从音节表里取出共享的Pinyin，用法和Pinyin的数组一样
+		class PinyinList {
+		public:
+			class iterator {
+			public:
+				using iterator_category = std::forward_iterator_tag;
+				using value_type = Pinyin;
+				using difference_type = std::ptrdiff_t;
+				using pointer = const Pinyin*;
+				using reference = const Pinyin&;
+				iterator() = default;
+				iterator(const PinIn* ctx, const uint32_t* it) :ctx{ ctx }, it{ it } {}
+				const Pinyin& operator*()const noexcept {
+					return ctx->syllables[*it];
+				}
+				const Pinyin* operator->()const noexcept {
+					return &ctx->syllables[*it];
+				}
+				iterator& operator++()noexcept {
+					++it;
+					return *this;
+				}
+				iterator operator++(int)noexcept {
+					iterator result = *this;
+					++it;
+					return result;
+				}
+				bool operator==(const iterator& o)const noexcept {
+					return it == o.it;
+				}
+			private:
+				const PinIn* ctx = nullptr;
+				const uint32_t* it = nullptr;
+			};
+			PinyinList(const PinIn& ctx, const std::vector<uint32_t>& ids) :ctx{ ctx }, ids{ ids } {}
+			iterator begin()const noexcept {
+				return iterator(&ctx, ids.data());
+			}
+			iterator end()const noexcept {
+				return iterator(&ctx, ids.data() + ids.size());
+			}
+			const Pinyin& operator[](size_t i)const noexcept {
+				return ctx.syllables[ids[i]];
+			}
+			size_t size()const noexcept {
+				return ids.size();
+			}
+			bool empty()const noexcept {
+				return ids.empty();
+			}
+		private:
+			const PinIn& ctx;
+			const std::vector<uint32_t>& ids;
+		};
 		class Character : public Element {
 		public:
 			virtual ~Character() = default;
@@ -328,25 +490,30 @@ namespace PinInCpp {
 			const std::string& get()const noexcept {
 				return ch;
 			}
-			const std::vector<Pinyin>& GetPinyins()const noexcept {
-				return pinyin;
+			PinyinList GetPinyins()const noexcept {//返回的列表引用着这个对象，不要让它活得比Character久
+				return PinyinList(ctx, syllables);
 			}
-			void reload() {
-				for (auto& p : pinyin) {
-					p.reload();
-				}
+			const std::vector<uint32_t>& GetSyllableIds()const noexcept {
+				return syllables;
 			}
 			IndexSet match(const Utf8String& str, size_t start, bool partial)const noexcept;
+			size_t MemoryUsage()const noexcept {//对象本身以外的堆内存，拼音和音素在音节表里，不算在这里
+				return HeapBytes(ch) + HeapBytes(syllables);
+			}
 			const size_t id;//代表这个字符的一个主拼音id
 		private:
 			friend PinIn;//由PinIn类执行构建
 			Character(const PinIn& p, const std::string_view& ch, const size_t id);
 			const PinIn& ctx;
 			const std::string ch;//需要持有一个字符串，因为这个是依赖输入源的，不是拼音数据
-			std::vector<Pinyin> pinyin;
+			std::vector<uint32_t> syllables;//各个读音在音节表里的序号
 		};
 	private:
+		void TextParser(const char* input_data, size_t size);
 		void LineParser(const std::string_view str);
+		static bool IsBinaryDictionary(const char* input_data, size_t size)noexcept;
+		void BinaryLoader(const char* input_data, size_t size, bool copy);
+		void BuildSyllables();//字典加载完成后建立音节表
 		//不是StringPoolBase的派生类，是用于Pinyin的内存空间优化的类
 		class CharPool {//字符每一个拼音都是唯一的，不需要查重，也不需要删改
 		public:
@@ -356,24 +523,191 @@ namespace PinInCpp {
 			std::vector<std::string> getPinyinVec(size_t i)const;
 			std::string_view getPinyinView(size_t i)const;
 			std::vector<std::string_view> getPinyinViewVec(size_t i, bool hasTone = false)const;//去除声调不去重，去重由公开接口自己去
+			template<typename Fn>
+			void ForEachPinyin(size_t i, Fn fn)const {//逐个访问带声调的拼音和它在池里的位置，不分配内存
+				size_t start = i;
+				while (true) {
+					const char c = FixedStrs[i];
+					if (c == ',' || c == '\0') {
+						fn(std::string_view(FixedStrs + start, i - start), start);
+						if (c == '\0') {
+							return;
+						}
+						start = i + 1;
+					}
+					i++;
+				}
+			}
 			bool empty()const noexcept {
-				return strs->empty();
+				return FixedSize == 0;
 			}
 			void Fixed() {//构造完成后固定，将原有向量析构掉，用更轻量的std::unique_ptr<char[]>取代，向量预分配开销去除
-				FixedStrs = std::unique_ptr<char[]>(new char[strs->size()]);
-				memcpy(FixedStrs.get(), strs->data(), strs->size());
+				OwnedStrs = std::unique_ptr<char[]>(new char[strs->size()]);
+				memcpy(OwnedStrs.get(), strs->data(), strs->size());
+				FixedStrs = OwnedStrs.get();
+				FixedSize = strs->size();
+				strs.reset(nullptr);
+			}
+			void Attach(const char* input_data, size_t size) {//直接使用外部的只读数据(如内存映射)，不拷贝也不持有，生命周期由调用方保证
 				strs.reset(nullptr);
+				OwnedStrs.reset(nullptr);
+				FixedStrs = input_data;
+				FixedSize = size;
+			}
+			const char* data()const noexcept {
+				return FixedStrs;
 			}
-			char* data() noexcept {
-				return FixedStrs.get();
+			size_t size()const noexcept {
+				return FixedSize;
+			}
+			size_t MemoryUsage()const noexcept {//构建期是向量，固定后是自己持有的副本，映射时不占堆内存
+				if (strs != nullptr) {
+					return sizeof(std::vector<char>) + HeapBytes(*strs);
+				}
+				return OwnedStrs != nullptr ? FixedSize : 0;
 			}
 		private:
 			std::unique_ptr<std::vector<char>> strs = std::make_unique<std::vector<char>>();//用这个存储包括向量的结构，优化内存占用的同时存储完整的拼音字符串并提供id
-			std::unique_ptr<char[]> FixedStrs = nullptr;
+			std::unique_ptr<char[]> OwnedStrs = nullptr;
+			const char* FixedStrs = nullptr;//固定后的只读数据，指向OwnedStrs或者外部的映射
+			size_t FixedSize = 0;
 		};
+		//Unicode码到拼音id的二级页表，一级表是每256个码位一页的页号，二级表是页内的拼音id，页号0是全空的页
+		//覆盖全部Unicode码位，查找是O1且无分配的，布局和二进制字典中的一致，所以映射后可以原地使用
+		class CharTable {
+		public:
+			static constexpr uint32_t PageBits = 8;
+			static constexpr uint32_t PageSize = 1 << PageBits;
+			static constexpr uint32_t IndexSize = 0x110000 >> PageBits;//一级表项数，最大码位是0x10FFFF
+			static constexpr uint32_t NullId = static_cast<uint32_t>(-1);//页表内紧凑存储的空拼音id
+
+			void put(char32_t unicode, size_t id) {//重复的码位后插入的覆盖前面的
+				if (unicode >= 0x110000) {
+					return;
+				}
+				uint16_t& page = index[unicode >> PageBits];
+				if (page == 0) {//空页写时分配
+					page = static_cast<uint16_t>(pages.size() / PageSize);
+					pages.resize(pages.size() + PageSize, NullId);
+				}
+				pages[(static_cast<size_t>(page) << PageBits) | (unicode & (PageSize - 1))] = static_cast<uint32_t>(id);
+			}
+			void Fixed() {//构建完成，固定指针
+				pages.shrink_to_fit();
+				FixedIndex = index.data();
+				FixedPages = pages.data();
+				FixedPagesSize = pages.size();
+			}
+			void Attach(const uint16_t* index_data, const uint32_t* pages_data, size_t pages_size) {//同CharPool::Attach
+				index.clear();
+				index.shrink_to_fit();
+				pages.clear();
+				pages.shrink_to_fit();
+				FixedIndex = index_data;
+				FixedPages = pages_data;
+				FixedPagesSize = pages_size;
+			}
+			size_t find(uint32_t fourCC)const noexcept {//找不到时返回NullPinyinId
+				return at(slot(fourCC));
+			}
+			size_t slot(uint32_t fourCC)const noexcept {//返回字符在二级表中的位置，非法的编码返回的是0号空页的位置
+				char32_t unicode = FourCCToUnicode(fourCC);
+				if (unicode >= 0x110000) {
+					return 0;
+				}
+				return (static_cast<size_t>(FixedIndex[unicode >> PageBits]) << PageBits) | (unicode & (PageSize - 1));
+			}
+			size_t at(size_t slot)const noexcept {
+				uint32_t id = FixedPages[slot];
+				return id == NullId ? NullPinyinId : id;
+			}
+			const uint16_t* IndexData()const noexcept {
+				return FixedIndex;
+			}
+			const uint32_t* PagesData()const noexcept {
+				return FixedPages;
+			}
+			size_t PagesSize()const noexcept {//二级表的uint32_t数量
+				return FixedPagesSize;
+			}
+			size_t MemoryUsage()const noexcept {//映射时两个向量都已经释放
+				return HeapBytes(index) + HeapBytes(pages);
+			}
+		private:
+			//解码FourCC打包的utf8字符，非法的编码返回一个越界的码位
+			static char32_t FourCCToUnicode(uint32_t c) noexcept {
+				if (c < 0x80) {
+					return c;
+				}
+				else if (c <= 0xFFFF) {
+					return (c & 0xE0C0) == 0xC080 ? ((c >> 2) & 0x7C0) | (c & 0x3F) : 0x110000;
+				}
+				else if (c <= 0xFFFFFF) {
+					return (c & 0xF0C0C0) == 0xE08080 ? ((c >> 4) & 0xF000) | ((c >> 2) & 0xFC0) | (c & 0x3F) : 0x110000;
+				}
+				else {
+					return (c & 0xF8C0C0C0) == 0xF0808080 ? ((c >> 6) & 0x1C0000) | ((c >> 4) & 0x3F000) | ((c >> 2) & 0xFC0) | (c & 0x3F) : 0x110000;
+				}
+			}
+			std::vector<uint16_t> index = std::vector<uint16_t>(IndexSize, 0);//构建期和持有数据时使用的容器
+			std::vector<uint32_t> pages = std::vector<uint32_t>(PageSize, NullId);//预置全空的0号页
+			const uint16_t* FixedIndex = nullptr;
+			const uint32_t* FixedPages = nullptr;
+			size_t FixedPagesSize = 0;
+		};
+		std::unique_ptr<MappedFile> mapping = nullptr;//二进制字典的映射，pool和data会直接引用其中的数据
 		CharPool pool;
-		std::unordered_map<uint32_t, size_t> data;//用数字size_t是指代内部拼音数字id，可以用pool提供的方法提供向量，用uint32_t代表utf8编码的字符，开销更小，无堆分配
-		std::optional<std::unordered_map<size_t, std::unique_ptr<Character>>> CharCache = std::unordered_map<size_t, std::unique_ptr<Character>>();//默认开启
+		CharTable data;
+		//音节表，字典里每个不同的带声调拼音一个Pinyin，音素在构建和Config::commit时预先算好，所有字符共享
+		//加载完成后只在commit时重载，搜索时只读，所以多个线程可以无锁访问
+		std::vector<Pinyin> syllables;
+		std::unordered_map<std::string_view, uint32_t> SyllableIndex;//带声调拼音到音节序号，视图指向pool的数据
+		//字符缓存，槽位和CharTable的二级表一一对应，所以每个有拼音的字符都有自己的槽位，最后一个槽位给所有无拼音的字符共用
+		class CharCacheTable {
+		public:
+			CharCacheTable(size_t size) :slots{ new std::atomic<Character*>[size] }, size{ size } {
+				for (size_t i = 0; i < size; i++) {
+					slots[i].store(nullptr, std::memory_order_relaxed);
+				}
+			}
+			~CharCacheTable() {
+				for (size_t i = 0; i < size; i++) {
+					delete slots[i].load(std::memory_order_relaxed);
+				}
+			}
+			CharCacheTable(const CharCacheTable&) = delete;
+			CharCacheTable(CharCacheTable&&) = delete;
+			CharCacheTable& operator=(CharCacheTable&& src) = delete;
+
+			Character* get(size_t slot)const noexcept {
+				return slots[slot].load(std::memory_order_acquire);
+			}
+			//尝试插入，如果其他线程抢先插入了，则丢弃自己构建的对象，返回的始终是槽位里最终的那个
+			Character* insert(size_t slot, std::unique_ptr<Character> ch) {
+				Character* expected = nullptr;
+				if (slots[slot].compare_exchange_strong(expected, ch.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+					return ch.release();
+				}
+				return expected;
+			}
+			size_t NullSlot()const noexcept {
+				return size - 1;
+			}
+			size_t MemoryUsage()const noexcept {
+				size_t bytes = size * sizeof(std::atomic<Character*>);
+				for (size_t i = 0; i < size; i++) {
+					const Character* ch = slots[i].load(std::memory_order_acquire);
+					if (ch != nullptr) {
+						bytes += sizeof(Character) + ch->MemoryUsage();
+					}
+				}
+				return bytes;
+			}
+		private:
+			std::unique_ptr<std::atomic<Character*>[]> slots;
+			const size_t size;
+		};
+		std::unique_ptr<CharCacheTable> CharCache = nullptr;//默认开启，在构造完成后创建
 
 		template<typename T>//不需要音调需要处理
 		static std::vector<T> DeleteTone(const PinIn* ctx, size_t id) {
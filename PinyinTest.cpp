@@ -80,7 +80,7 @@ int main() {
 
 	//插入耗时，比Java的快了，目前提供了缓存支持，主要原因还是在utf8字符串处理之类的问题上，当然内存占用也是如此(更大)，毕竟utf8比utf16浪费内存，而且有std::string作为key的开销
 	//目前已利用FourCC技术，将单UTF8字符高效的打包成uint32_t，利用缓冲区技术快速解包回去，实现单字符key的高效存储，避免字符串哈希
-	//而且为了保证内存池的utf8字符串O1的随机访问，我实现了一个UTF8StringPool::chars_offset成员，必不可少但是也耗费更多内存了
+	//而且为了保证内存池的utf8字符串O1的随机访问，UTF8StringPool有一个字符索引，现在是每64个字符一个偏移加上每字符2位的长度，平均每字符3位左右
 	//内存占用的问题部分还来源size_t类型，因为64位下是八字节大的，基本上是翻倍了
 
 	while (true) {//死循环，你可以随便搜索测试集的内容用于测试
@@ -0,0 +1,81 @@
+#include "SearchStats.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace PinInCpp {
+	void SearchStats::merge(const SearchStats& o)noexcept {
+		DenseNodes += o.DenseNodes;
+		SliceNodes += o.SliceNodes;
+		MapNodes += o.MapNodes;
+		AccNodes += o.AccNodes;
+		MemoHits += o.MemoHits;
+		MemoMisses += o.MemoMisses;
+		PhonemeMatches += o.PhonemeMatches;
+		CheckCalls += o.CheckCalls;
+		MaxCheckDepth = std::max(MaxCheckDepth, o.MaxCheckDepth);
+		RawResults += o.RawResults;
+		UniqueResults += o.UniqueResults;
+	}
+
+	SearchStats::Scope::Scope(SearchStats& stats, std::string_view query, SearchStatsCollector* collector)
+		:stats{ stats }, prev{ current }, query{ query }, collector{ collector }, start{ Clock::now() } {
+		stats = SearchStats();
+		stats.last = start;
+		current = &stats;
+	}
+
+	SearchStats::Scope::~Scope() {
+		current = prev;
+		stats.TotalNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+		const uint64_t measured = stats.PrepareNs + stats.TraverseNs;
+		stats.CollectNs = stats.TotalNs > measured ? stats.TotalNs - measured : 0;
+		if (collector != nullptr) {
+			try {
+				collector->add(query, stats);
+			}
+			catch (...) {}//析构函数里不能抛出，统计丢一条无所谓
+		}
+	}
+
+	size_t SearchStatsCollector::bucket(uint64_t value)noexcept {
+		const size_t i = value == 0 ? 0 : static_cast<size_t>(std::bit_width(value)) - 1;
+		return std::min(i, BucketNum - 1);
+	}
+
+	void SearchStatsCollector::add(std::string_view query, const SearchStats& stats) {
+		std::lock_guard<std::mutex> lk(mtx);
+		data.queries++;
+		data.total.merge(stats);
+		data.total.PrepareNs += stats.PrepareNs;
+		data.total.TraverseNs += stats.TraverseNs;
+		data.total.CollectNs += stats.CollectNs;
+		data.total.TotalNs += stats.TotalNs;
+		data.LatencyHistogram[bucket(stats.TotalNs / 1000)]++;
+		data.NodesHistogram[bucket(stats.NodesVisited())]++;
+		if (SlowestNum == 0) {
+			return;
+		}
+		auto& slowest = data.slowest;
+		if (slowest.size() == SlowestNum && stats.TotalNs <= slowest.back().second.TotalNs) {
+			return;
+		}
+		auto it = std::upper_bound(slowest.begin(), slowest.end(), stats.TotalNs, [](uint64_t t, const std::pair<std::string, SearchStats>& e) {
+			return t > e.second.TotalNs;
+		});
+		slowest.emplace(it, std::string(query), stats);
+		if (slowest.size() > SlowestNum) {
+			slowest.pop_back();
+		}
+	}
+
+	SearchStatsCollector::Summary SearchStatsCollector::summary()const {
+		std::lock_guard<std::mutex> lk(mtx);
+		return data;
+	}
+
+	void SearchStatsCollector::reset() {
+		std::lock_guard<std::mutex> lk(mtx);
+		data = Summary();
+	}
+}
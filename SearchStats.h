@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <chrono>
+
+/*
+逐次查询的统计计数，编译时定义PININCPP_STATS才会启用
+
+启用后每次ExecuteSearch系列调用都会统计：按类型访问的节点数、Accelerator记忆表的命中/未命中、音素匹配次数、check的调用次数和最大递归深度、去重前后的结果数，以及各阶段耗时
+计数通过线程局部的当前统计对象进行，搜索路径上只是判断一次指针，不需要把统计对象传进每个函数
+未定义时所有统计宏展开为空，搜索路径上没有任何开销，LastStats()始终是全0
+*/
+
+#ifdef PININCPP_STATS
+//对当前线程正在统计的对象执行expr，没有正在进行的统计时什么都不做
+#define PININCPP_STAT(expr) do { if (::PinInCpp::SearchStats* PinInStats_ = ::PinInCpp::SearchStats::current) { PinInStats_->expr; } } while (false)
+//一次查询的统计范围，开始时清空stats，结束时计算总耗时并交给collector(可以为空)
+#define PININCPP_STATS_SCOPE(stats, query, collector) ::PinInCpp::SearchStats::Scope PinInStatsScope_(stats, query, collector)
+//把当前线程的统计转到stats上，不清空也不计时，给并行搜索的工作线程用
+#define PININCPP_STATS_BIND(stats) ::PinInCpp::SearchStats::Bind PinInStatsBind_(stats)
+//把上一个标记点到现在的耗时记到field上
+#define PININCPP_STATS_MARK(field) PININCPP_STAT(mark(&::PinInCpp::SearchStats::field))
+//Accelerator::check的递归深度
+#define PININCPP_STATS_CHECK_DEPTH() ::PinInCpp::SearchStats::DepthGuard PinInStatsDepth_
+#else
+#define PININCPP_STAT(expr) do {} while (false)
+#define PININCPP_STATS_SCOPE(stats, query, collector) do {} while (false)
+#define PININCPP_STATS_BIND(stats) do {} while (false)
+#define PININCPP_STATS_MARK(field) do {} while (false)
+#define PININCPP_STATS_CHECK_DEPTH() do {} while (false)
+#endif
+
+namespace PinInCpp {
+	class SearchStatsCollector;
+
+	struct SearchStats {
+#ifdef PININCPP_STATS
+		static constexpr bool enabled = true;
+#else
+		static constexpr bool enabled = false;
+#endif
+		//匹配过程中访问的节点，不包括查询结束后整棵子树直接收集结果的部分
+		size_t DenseNodes = 0;
+		size_t SliceNodes = 0;
+		size_t MapNodes = 0;
+		size_t AccNodes = 0;
+		size_t MemoHits = 0;//Accelerator记忆表
+		size_t MemoMisses = 0;
+		size_t PhonemeMatches = 0;//Phoneme::match的调用次数
+		size_t CheckCalls = 0;//Accelerator::check，包括递归
+		size_t MaxCheckDepth = 0;
+		size_t RawResults = 0;//交给结果接收方的id数，CONTAIN下同一个id会因为多个后缀重复出现
+		size_t UniqueResults = 0;//去重并去掉已删除条目之后的结果数
+		uint64_t PrepareNs = 0;//刷新配置和预处理搜索串
+		uint64_t TraverseNs = 0;//遍历树
+		uint64_t CollectNs = 0;//剩下的部分，主要是把id转换成输出格式
+		uint64_t TotalNs = 0;
+
+		size_t NodesVisited()const noexcept {
+			return DenseNodes + SliceNodes + MapNodes + AccNodes;
+		}
+		void merge(const SearchStats& o)noexcept;//计数相加，MaxCheckDepth取最大值，耗时不合并
+
+		using Clock = std::chrono::steady_clock;
+		void mark(uint64_t SearchStats::* field)noexcept {
+			const Clock::time_point now = Clock::now();
+			this->*field += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+			last = now;
+		}
+
+		static inline thread_local SearchStats* current = nullptr;
+
+		class Scope {
+		public:
+			Scope(SearchStats& stats, std::string_view query, SearchStatsCollector* collector);
+			~Scope();
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		private:
+			SearchStats& stats;
+			SearchStats* prev;
+			std::string_view query;
+			SearchStatsCollector* collector;
+			Clock::time_point start;
+		};
+		class Bind {
+		public:
+			Bind(SearchStats& stats)noexcept :prev{ current } {
+				current = &stats;
+			}
+			~Bind() {
+				current = prev;
+			}
+			Bind(const Bind&) = delete;
+			Bind& operator=(const Bind&) = delete;
+		private:
+			SearchStats* prev;
+		};
+		class DepthGuard {
+		public:
+			DepthGuard()noexcept :stats{ current } {
+				if (stats != nullptr) {
+					stats->CheckCalls++;
+					if (++stats->depth > stats->MaxCheckDepth) {
+						stats->MaxCheckDepth = stats->depth;
+					}
+				}
+			}
+			~DepthGuard() {
+				if (stats != nullptr) {
+					stats->depth--;
+				}
+			}
+			DepthGuard(const DepthGuard&) = delete;
+			DepthGuard& operator=(const DepthGuard&) = delete;
+		private:
+			SearchStats* stats;
+		};
+	private:
+		size_t depth = 0;//check当前的递归深度
+		Clock::time_point last;//上一个标记点
+	};
+
+	/*
+	查询统计的汇总，可以被多个TreeSearcher共享，多个线程同时提交
+	耗时和访问节点数按2的幂分桶做直方图，并记住最慢的几个查询和它们各自的统计，用来找出病态查询和调整各个节点的阈值
+	*/
+	class SearchStatsCollector {
+	public:
+		static constexpr size_t BucketNum = 32;
+		explicit SearchStatsCollector(size_t SlowestNum = 16) :SlowestNum{ SlowestNum } {}
+
+		struct Summary {
+			size_t queries = 0;
+			SearchStats total;//各项计数的总和，MaxCheckDepth是最大值
+			std::array<size_t, BucketNum> LatencyHistogram{};//第i个桶是总耗时在[2^i, 2^(i+1))微秒的查询数，第0个桶包括不到1微秒的
+			std::array<size_t, BucketNum> NodesHistogram{};//访问节点数，分桶方式同上
+			std::vector<std::pair<std::string, SearchStats>> slowest;//最慢的几个查询，从慢到快排列
+		};
+		void add(std::string_view query, const SearchStats& stats);
+		Summary summary()const;
+		void reset();
+	private:
+		static size_t bucket(uint64_t value)noexcept;
+		mutable std::mutex mtx;
+		size_t SlowestNum;
+		Summary data;
+	};
+}
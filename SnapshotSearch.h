@@ -0,0 +1,209 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <array>
+
+#include "TreeSearcher.h"
+
+namespace PinInCpp {
+	/*
+	读写分离的快照搜索，可以一边持续写入一边提供搜索，搜索线程永远不会被写入阻塞
+
+	内部是两棵内容交替同步的TreeSearcher(左右双缓冲)，搜索线程只读前台的那棵，写入线程只改后台的那棵
+	publish()原子地交换前后台，之后新的搜索看到的就是新版本，还在读旧版本的搜索不受影响
+	旧的前台变成后台以后，下一次写入会先等它的读者全部离开(宽限期)，再把它错过的修改重放一遍，两棵树的id因此始终一致
+
+	读者用acquire()拿到一个Snapshot，持有期间它引用的树、id和字符串视图都不会变化，只是两个计数器的增减，没有锁
+	代价是两倍的内存和两倍的写入开销，而且长时间持有Snapshot会让下一次写入一直等待
+	写入接口可以被多个线程调用，内部串行执行。PinIn的配置变化在下一次publish()时生效
+	*/
+	class SnapshotSearch {
+	public:
+		SnapshotSearch(Logic logic, const std::string_view& PinyinDictionaryPath)
+			:SnapshotSearch(logic, std::make_shared<PinIn>(PinyinDictionaryPath)) {
+		}
+		SnapshotSearch(Logic logic, const std::vector<char>& PinyinDictionaryData)
+			:SnapshotSearch(logic, std::make_shared<PinIn>(PinyinDictionaryData)) {
+		}
+		SnapshotSearch(Logic logic, std::shared_ptr<PinIn> PinInShared) {
+			for (auto& b : buffers) {
+				b.tree = std::make_unique<TreeSearcher>(logic, PinInShared);
+			}
+		}
+		SnapshotSearch(const SnapshotSearch&) = delete;
+		SnapshotSearch(SnapshotSearch&&) = delete;
+		SnapshotSearch& operator=(SnapshotSearch&& src) = delete;
+
+		class Snapshot {//某一个版本的只读引用，只能移动，析构时释放，不要比SnapshotSearch活得更久
+		public:
+			Snapshot(Snapshot&& src)noexcept :owner{ src.owner }, index{ src.index } {
+				src.owner = nullptr;
+			}
+			Snapshot& operator=(Snapshot&& src)noexcept {
+				if (this != &src) {
+					release();
+					owner = src.owner;
+					index = src.index;
+					src.owner = nullptr;
+				}
+				return *this;
+			}
+			~Snapshot() {
+				release();
+			}
+			const TreeSearcher& tree()const noexcept {//用只读接口搜索，需要配合Reader或者自己的SearchContext
+				return *owner->buffers[index].tree;
+			}
+			size_t version()const noexcept {//发布的次数，越大越新
+				return owner->buffers[index].version;
+			}
+		private:
+			friend SnapshotSearch;
+			Snapshot(const SnapshotSearch& owner, size_t index) :owner{ &owner }, index{ index } {}
+			void release()noexcept {
+				if (owner != nullptr) {
+					owner->buffers[index].readers.fetch_sub(1);
+					owner = nullptr;
+				}
+			}
+			const SnapshotSearch* owner;
+			size_t index;
+		};
+		Snapshot acquire()const {//取得当前前台版本，不会阻塞
+			while (true) {
+				const size_t index = front.load();
+				buffers[index].readers.fetch_add(1);
+				if (front.load() == index) {//计数之后前台没有变，写入线程一定能看到这个读者
+					return Snapshot(*this, index);
+				}
+				buffers[index].readers.fetch_sub(1);//刚好赶上交换，这棵树可能已经在被修改了，重来
+			}
+		}
+
+		class Reader {//读者的查询状态，每个搜索线程各自持有一个，两棵树各有一个SearchContext
+		public:
+			Reader(const SnapshotSearch& owner) :owner{ owner } {}
+			Reader(const Reader&) = delete;
+			Reader(Reader&&) = delete;
+			Reader& operator=(Reader&& src) = delete;
+
+			TreeSearcher::SearchContext& context(const Snapshot& snapshot) {//和snapshot.tree()配套的上下文
+				std::unique_ptr<TreeSearcher::SearchContext>& ctx = contexts[snapshot.index];
+				if (ctx == nullptr) {
+					ctx = std::make_unique<TreeSearcher::SearchContext>(snapshot.tree());
+				}
+				return *ctx;
+			}
+			//在当前版本上搜索，返回的字符串是复制出来的，不依赖快照
+			std::vector<std::string> ExecuteSearch(const std::string_view& s) {
+				Snapshot snapshot = owner.acquire();
+				return snapshot.tree().ExecuteSearch(context(snapshot), s);
+			}
+			std::vector<std::string> ExecuteSearchTopK(const std::string_view& s, size_t k, const TreeSearcher::Scorer& scorer = nullptr, int64_t MaxScore = INT64_MAX) {
+				Snapshot snapshot = owner.acquire();
+				return snapshot.tree().ExecuteSearchTopK(context(snapshot), s, k, scorer, MaxScore);
+			}
+			//回调期间持有快照，视图在回调返回前有效
+			void ExecuteSearchStream(const std::string_view& s, const TreeSearcher::Callback& callback) {
+				Snapshot snapshot = owner.acquire();
+				snapshot.tree().ExecuteSearchStream(context(snapshot), s, callback);
+			}
+		private:
+			const SnapshotSearch& owner;
+			std::array<std::unique_ptr<TreeSearcher::SearchContext>, 2> contexts;
+		};
+
+		//以下是写入接口，修改的是后台的树，publish()之前读者看不到
+		void put(const std::string_view& keyword) {
+			std::lock_guard<std::mutex> lk(WriteMtx);
+			TreeSearcher& tree = back();
+			tree.put(keyword);
+			log.push_back(Op{ Op::PUT, std::string(keyword), 0 });
+		}
+		bool erase(size_t id) {//id同TreeSearcher::erase，两棵树的id一致，所以从快照里拿到的id可以直接用
+			std::lock_guard<std::mutex> lk(WriteMtx);
+			if (!back().erase(id)) {
+				return false;
+			}
+			log.push_back(Op{ Op::ERASE, std::string(), id });
+			return true;
+		}
+		size_t update(size_t id, const std::string_view& keyword) {
+			std::lock_guard<std::mutex> lk(WriteMtx);
+			const size_t result = back().update(id, keyword);
+			log.push_back(Op{ Op::UPDATE, std::string(keyword), id });
+			return result;
+		}
+		void Compact() {//id会重新编号，发布之前从旧快照拿到的id不能再用于写入
+			std::lock_guard<std::mutex> lk(WriteMtx);
+			back().Compact();
+			log.push_back(Op{ Op::COMPACT, std::string(), 0 });
+		}
+		void publish() {//把后台的修改发布出去，没有修改时也会交换，用来让PinIn的配置变化生效
+			std::lock_guard<std::mutex> lk(WriteMtx);
+			TreeSearcher& tree = back();
+			tree.refresh();
+			const size_t index = 1 - front.load();
+			buffers[index].version = ++published;
+			front.store(index);
+			//旧的前台要等读者离开后才能修改，这里不等，留给下一次写入
+			missed = std::move(log);
+			log.clear();
+			synced = false;
+		}
+	private:
+		struct Op {//后台树上执行过的修改，交换后在另一棵树上重放
+			enum Kind : uint8_t {
+				PUT, ERASE, UPDATE, COMPACT
+			};
+			Kind kind;
+			std::string str;
+			size_t id;
+		};
+		struct alignas(64) Buffer {//读者计数各占一条缓存行，避免两棵树的计数互相干扰
+			std::unique_ptr<TreeSearcher> tree;
+			mutable std::atomic<size_t> readers = 0;
+			size_t version = 0;
+		};
+		TreeSearcher& back() {//取得可以修改的后台树，必要时先等宽限期结束并重放错过的修改
+			Buffer& b = buffers[1 - front.load()];
+			if (!synced) {
+				while (b.readers.load() != 0) {
+					std::this_thread::yield();
+				}
+				for (const Op& op : missed) {
+					apply(*b.tree, op);
+				}
+				missed.clear();
+				synced = true;
+			}
+			return *b.tree;
+		}
+		static void apply(TreeSearcher& tree, const Op& op) {
+			switch (op.kind) {
+			case Op::PUT:
+				tree.put(op.str);
+				break;
+			case Op::ERASE:
+				tree.erase(op.id);
+				break;
+			case Op::UPDATE:
+				tree.update(op.id, op.str);
+				break;
+			case Op::COMPACT:
+				tree.Compact();
+				break;
+			}
+		}
+
+		std::array<Buffer, 2> buffers;
+		std::atomic<size_t> front = 0;
+		std::mutex WriteMtx;
+		std::vector<Op> log;//这一轮写入在后台树上执行过的修改
+		std::vector<Op> missed;//后台树还没有重放的、上一轮发布的修改
+		bool synced = true;//后台树是否已经追上了前台
+		size_t published = 0;
+	};
+}
@@ -1,8 +1,7 @@
 #include "StringPool.h"
 
 namespace PinInCpp {
-	UTF8StringPool::UTF8StringPool() {
-		chars_offset.push_back(0);//初始化时在开头添加0作为元素，可以避免if检查上一个元素是否越界
+	UTF8StringPool::UTF8StringPool() :BlockBase(1, 0), CharBits(2, 0) {//0号块始终存在，空池的ByteOffset(0)也是合法的
 		//strs_offset.push_back(0);
 	}
 	/*
@@ -21,27 +20,64 @@ namespace PinInCpp {
 	}*/
 
 	size_t UTF8StringPool::put(const std::string_view& s) {
+		Utf8StringView utf8s(s);
+		constexpr size_t IndexMax = static_cast<size_t>(static_cast<PoolIndex>(-1));
+		//插入前检查容量，字节数和字符数(都包含结尾符)都需要能被PoolIndex表示，失败时池不会被改动
+		if (s.size() >= IndexMax - strs.size() || utf8s.size() >= IndexMax - last_offset) {
+			throw std::length_error("UTF8StringPool exceeds the capacity of PoolIndex");
+		}
 		strs.insert(strs.end(), s.begin(), s.end());//数据插入
 
-		Utf8StringView utf8s(s);
 		last_size = utf8s.size();
 		size_t result = last_offset;
 		for (const auto& str : utf8s) {
-			last_offset++;
-			chars_offset.push_back(chars_offset[chars_offset.size() - 1] + str.size());
+			PushChar(str.size());
 		}
-		last_offset++;//空字符也有呢
 		strs.push_back('\0');
-		chars_offset.push_back(chars_offset[chars_offset.size() - 1] + 1);//结尾符的宽度
+		PushChar(1);//空字符也有呢
 		return result;
 	}
 
+	void UTF8StringPool::assign(const char* input_data, size_t size, const uint64_t* LengthBitsData, size_t LengthBitsSize, size_t CharCount) {
+		//长度位累加出的总字节数必须正好等于size，最后一个字节必须是结尾符，这样任何合法的字符索引都不会越界
+		//最后一块里CharCount之后的位必须是0，之后put时才能直接置位
+		const size_t blocks = CharCount / BlockSize + 1;
+		const size_t tail = CharCount & (BlockSize - 1);
+		const uint64_t TailMask = ~((static_cast<uint64_t>(1) << tail) - 1);
+		bool valid = LengthBitsSize == blocks * 2 && (size == 0 || input_data[size - 1] == '\0')
+			&& (LengthBitsData[blocks * 2 - 2] & TailMask) == 0 && (LengthBitsData[blocks * 2 - 1] & TailMask) == 0;
+		std::vector<PoolIndex> bases;
+		if (valid) {
+			bases.reserve(blocks);
+			size_t cursor = 0;
+			for (size_t b = 0; valid && b < blocks; b++) {
+				bases.push_back(static_cast<PoolIndex>(cursor));
+				if (b + 1 < blocks) {
+					cursor += BlockSize + std::popcount(LengthBitsData[b * 2]) + 2 * std::popcount(LengthBitsData[b * 2 + 1]);
+					valid = cursor <= size;
+				}
+				else {
+					const uint64_t mask = ~TailMask;
+					cursor += tail + std::popcount(LengthBitsData[b * 2] & mask) + 2 * std::popcount(LengthBitsData[b * 2 + 1] & mask);
+					valid = cursor == size;
+				}
+			}
+		}
+		if (!valid) {
+			throw std::invalid_argument("UTF8StringPool data or character lengths are inconsistent");
+		}
+		strs.assign(input_data, input_data + size);
+		BlockBase = std::move(bases);
+		CharBits.assign(LengthBitsData, LengthBitsData + LengthBitsSize);
+		last_offset = CharCount;
+		last_size = 0;
+	}
+
 	std::string UTF8StringPool::getchar(size_t i)const {
-		size_t size = chars_offset[i + 1];
-		size_t last = chars_offset[i];
+		size_t last = ByteOffset(i);
 
 		std::string result;
-		result.insert(result.end(), strs.begin() + last, strs.begin() + size);
+		result.insert(result.end(), strs.begin() + last, strs.begin() + last + CharSize(i));
 
 		return result;
 	}
@@ -49,7 +85,7 @@ namespace PinInCpp {
 	std::string UTF8StringPool::getstr(size_t strStart)const {
 		std::string result;
 
-		size_t i = chars_offset[strStart];
+		size_t i = ByteOffset(strStart);
 		while (strs[i]) {
 			result.push_back(strs[i]);
 			i++;
@@ -58,14 +94,11 @@ namespace PinInCpp {
 	}
 
 	std::string_view UTF8StringPool::getchar_view(size_t i)const noexcept {
-		size_t size = chars_offset[i + 1];
-		size_t last = chars_offset[i];
-
-		return std::string_view(strs.data() + last, size - last);
+		return std::string_view(strs.data() + ByteOffset(i), CharSize(i));
 	}
 
 	std::string_view UTF8StringPool::getstr_view(size_t strStart)const noexcept {
-		strStart = chars_offset[strStart];
+		strStart = ByteOffset(strStart);
 		size_t i = strStart;
 		while (strs[i]) {
 			i++;
@@ -74,11 +107,10 @@ namespace PinInCpp {
 	}
 
 	uint32_t UTF8StringPool::getcharFourCC(size_t i)const noexcept {
-		size_t size = chars_offset[i + 1];
-		size_t last = chars_offset[i];
+		size_t size = CharSize(i);
+		size_t last = ByteOffset(i);
 		uint32_t result = 0;
 
-		size -= last;
 		for (size_t i = 0; i < size; i++) {
 			result <<= 8;
 			result |= (uint8_t)strs[last + i];
@@ -86,13 +118,13 @@ namespace PinInCpp {
 		return result;
 	}
 	bool UTF8StringPool::EqualChar(size_t indexA, size_t indexB)const noexcept {
-		size_t AOffset = chars_offset[indexA];
-		size_t BOffset = chars_offset[indexB];
-		size_t Asize = chars_offset[indexA + 1] - AOffset;
-		size_t Bsize = chars_offset[indexB + 1] - BOffset;
+		size_t Asize = CharSize(indexA);
+		size_t Bsize = CharSize(indexB);
 		if (Asize != Bsize) {//两个字节大小都不一样，那肯定不相等
 			return false;
 		}
+		size_t AOffset = ByteOffset(indexA);
+		size_t BOffset = ByteOffset(indexB);
 		for (size_t i = 0; i < Asize; i++) {
 			if (strs[AOffset + i] != strs[BOffset + i]) {
 				return false;
@@ -1,15 +1,33 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <bit>
 
 #include "PinIn.h"
 
 
 namespace PinInCpp {
+	/*
+	字符串池的索引类型，TreeSearcher的节点、叶子和结果集也用它存储字符索引和字符串id
+	默认为size_t，编译时定义PININCPP_COMPACT_INDEX则改为uint32_t，64位环境下树的索引内存占用接近减半
+	代价是一个字符串池(即一棵树)最多容纳UINT32_MAX个字符(每个字符串的结尾符也算一个)和UINT32_MAX字节，超出时put会抛出std::length_error
+	*/
+#ifdef PININCPP_COMPACT_INDEX
+	using PoolIndex = uint32_t;
+#else
+	using PoolIndex = size_t;
+#endif
+
 	/*
 	Compressor
 
 	目前设计支持只支持UTF8的可变长编码，这是一个特化的，不可编辑的字符串池
+
+	字符索引是稀疏的：每64个字符一个块，记录块内第一个字符的字节偏移，再用两个64位字按位记录块内每个字符的字节长度减1(低位和高位)
+	字符的字节偏移 = 块的偏移 + 块内序号 + 两个字中序号之前的位的popcount(高位乘2)，依然是O1的
+	每个字符平均只占3位(PoolIndex为size_t时)，原来的每字符一个PoolIndex在CJK文本上比字符串本身还大
 	*/
 	class UTF8StringPool {
 	public:
@@ -19,30 +37,106 @@ namespace PinInCpp {
 			return strs_offset;
 		}*/
 		bool end(size_t i)const noexcept {
-			return strs[chars_offset[i]] == '\0';
+			return strs[ByteOffset(i)] == '\0';
 		}
 		size_t put(const std::string_view& s);//返回的是其插入完成后字符串首端索引
+		//用data()和LengthBits()导出的数据重建字符串池，不需要重新切分UTF8字符，块的偏移在这里重新累加
+		//CharCount同CharCount()，校验不通过时抛出std::invalid_argument，池保持原样
+		void assign(const char* input_data, size_t size, const uint64_t* LengthBitsData, size_t LengthBitsSize, size_t CharCount);
+		const char* data()const noexcept {//所有字符串的字节，每个字符串以\0结尾
+			return strs.data();
+		}
+		size_t size()const noexcept {//字节数
+			return strs.size();
+		}
+		size_t ByteOffset(size_t i)const noexcept {//字符的字节偏移，i可以等于CharCount()，这时是总字节数
+			const size_t b = i >> BlockBits;
+			const size_t k = i & (BlockSize - 1);
+			const uint64_t mask = (static_cast<uint64_t>(1) << k) - 1;
+			return static_cast<size_t>(BlockBase[b]) + k + std::popcount(CharBits[b * 2] & mask) + 2 * std::popcount(CharBits[b * 2 + 1] & mask);
+		}
+		size_t CharSize(size_t i)const noexcept {//字符的字节数，结尾符是1
+			const size_t b = i >> BlockBits;
+			const size_t k = i & (BlockSize - 1);
+			return 1 + ((CharBits[b * 2] >> k) & 1) + 2 * ((CharBits[b * 2 + 1] >> k) & 1);
+		}
+		const uint64_t* LengthBits()const noexcept {//每块两个字的字节长度位，元素数量为LengthBitsSize()
+			return CharBits.data();
+		}
+		size_t LengthBitsSize()const noexcept {
+			return CharBits.size();
+		}
+		size_t CharCount()const noexcept {//字符数，包括每个字符串的结尾符，合法的字符索引小于它
+			return last_offset;
+		}
 		std::string getchar(size_t i)const;//获取指定字符
 		std::string getstr(size_t strStart)const;//输入首端索引构造完整字符串
 		std::string_view getchar_view(size_t i)const noexcept;//获取指定字符的只读视图 持有时不要变动字符串池！
 		std::string_view getstr_view(size_t strStart)const noexcept;//输入首端索引构造完整字符串的只读视图 持有时不要变动字符串池！
+		std::string_view getrange_view(size_t first, size_t last)const noexcept {//字符区间[first, last)的只读视图，同上
+			const size_t begin = ByteOffset(first);
+			return std::string_view(strs.data() + begin, ByteOffset(last) - begin);
+		}
 		uint32_t getcharFourCC(size_t i)const noexcept;//针对单字符的FourCC打包编码的实现
 		size_t getLastStrSize()const noexcept {//获取上一个插入的UTF8字符串的长度
 			return last_size;
 		}
+		//按UTF8首字节数出字符数，不含结尾符，合法的UTF8字符串和put切分出的字符数一致，用来预估容量和开销
+		static size_t CountChars(const std::string_view& s)noexcept {
+			size_t count = 0;
+			for (const char c : s) {
+				count += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+			}
+			return count;
+		}
 		//单位是字节
 		void reserve(size_t _Newcapacity) {
 			strs.reserve(_Newcapacity);
 		}
+		void reserve(size_t _Newcapacity, size_t CharCapacity) {//同时预留字符索引，字符数包括结尾符
+			strs.reserve(_Newcapacity);
+			BlockBase.reserve(CharCapacity / BlockSize + 1);
+			CharBits.reserve((CharCapacity / BlockSize + 1) * 2);
+		}
 		bool EqualChar(size_t indexA, size_t indexB)const noexcept;
 		void ShrinkToFit() {
 			strs.shrink_to_fit();
 		}
+		struct MemoryReport {//单位是字节，按容量计算
+			size_t strs = 0;//字节数组
+			size_t CharIndex = 0;//稀疏的字符索引，块的偏移和字节长度位
+			size_t total()const noexcept {
+				return strs + CharIndex;
+			}
+		};
+		MemoryReport MemoryUsage()const noexcept {
+			return MemoryReport{ HeapBytes(strs), HeapBytes(BlockBase) + HeapBytes(CharBits) };
+		}
 	private:
+		static constexpr size_t BlockBits = 6;
+		static constexpr size_t BlockSize = static_cast<size_t>(1) << BlockBits;
+		void PushChar(size_t size) {//在末尾追加一个字符的索引，字节已经写入strs
+			const size_t k = last_offset & (BlockSize - 1);
+			const uint64_t bit = static_cast<uint64_t>(1) << k;
+			const size_t b = last_offset >> BlockBits;
+			if ((size - 1) & 1) {
+				CharBits[b * 2] |= bit;
+			}
+			if ((size - 1) & 2) {
+				CharBits[b * 2 + 1] |= bit;
+			}
+			last_offset++;
+			if (k == BlockSize - 1) {//块满了，始终保留CharCount()所在的块，ByteOffset(CharCount())不会越界
+				BlockBase.push_back(static_cast<PoolIndex>(ByteOffset(last_offset - 1) + size));
+				CharBits.push_back(0);
+				CharBits.push_back(0);
+			}
+		}
 		std::vector<char> strs;//字节数组，用于将多个字符串(字节流)放入容器中，避免内存碎片
 		//std::vector<size_t> strs_offset;//表示每组字符串的宽度偏移量
 		size_t last_offset = 0;//替代设计
 		size_t last_size = 0;
-		std::vector<size_t> chars_offset;//索引表示的为字符的位置，值表示的是字符的末尾，用上一个值代表字符的开始
+		std::vector<PoolIndex> BlockBase;//每块第一个字符的字节偏移，块数为CharCount()/64+1
+		std::vector<uint64_t> CharBits;//每块两个字，第i位是块内第i个字符的字节长度减1的低位和高位
 	};
 }
@@ -1,130 +1,759 @@
 #include "TreeSearcher.h"
 
+#include <algorithm>
+#include <fstream>
+
 namespace PinInCpp {
 
 	void TreeSearcher::put(const std::string_view& keyword) {
+		if (frozen != nullptr) {
+			throw std::logic_error("TreeSearcher is frozen");
+		}
 		ticket->renew();
+		version++;
 		size_t pos = strs.put(keyword);
 		size_t end = logic == Logic::CONTAIN ? strs.getLastStrSize() : 1;
 		for (size_t i = 0; i < end; i++) {
-			Node* result = root->put(*this, pos + i, pos);
-			if (root.get() != result) {
-				NodeOwnershipReset(root, result);
+			PutChild(root, pos + i, pos);
+		}
+	}
+
+	void TreeSearcher::get(NodeHandle n, Accelerator& acc, ResultSink& ret, size_t offset)const {
+		if (ret.stopped()) {
+			return;
+		}
+		if (ret.forks != nullptr && n != ret.ForkRoot) {
+			ret.forks->emplace_back(n, offset);
+			return;
+		}
+		const uint32_t i = GetNodeIndex(n);
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE:
+			PININCPP_STAT(DenseNodes++);
+			if (ret.frontier != nullptr && offset < acc.search().size()) {
+				ret.frontier->push_back(FrontierEntry{ FrontierEntry::DENSE, n, 0, 0, offset });
 			}
+			NDensePool[i].get(*this, acc, ret, offset);
+			break;
+		case NodeType::SLICE:
+			PININCPP_STAT(SliceNodes++);
+			NSlicePool[i].get(*this, acc, ret, offset, 0, n);
+			break;
+		case NodeType::MAP:
+			PININCPP_STAT(MapNodes++);
+			NMapPool[i].get(*this, acc, ret, offset);
+			break;
+		case NodeType::ACC:
+			PININCPP_STAT(AccNodes++);
+			NAccPool[i].get(*this, acc, ret, offset);
+			break;
 		}
 	}
 
+	void TreeSearcher::get(NodeHandle n, ResultSink& ret)const {
+		const uint32_t i = GetNodeIndex(n);
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE:
+			NDensePool[i].get(*this, ret);
+			break;
+		case NodeType::SLICE:
+			NSlicePool[i].get(*this, ret);
+			break;
+		case NodeType::MAP:
+			NMapPool[i].get(*this, ret);
+			break;
+		case NodeType::ACC:
+			NAccPool[i].get(*this, ret);
+			break;
+		}
+	}
+
+	void TreeSearcher::PutBatch(std::span<const std::string_view> keywords, WorkStealingPool& pool) {
+		if (frozen != nullptr) {
+			throw std::logic_error("TreeSearcher is frozen");
+		}
+		ticket->renew();
+		version++;
+		//先数出总字节数和字符数，字符串池只扩容一次
+		size_t bytes = 0;
+		size_t chars = 0;
+		for (const std::string_view& keyword : keywords) {
+			bytes += keyword.size() + 1;
+			chars += UTF8StringPool::CountChars(keyword) + 1;
+		}
+		strs.reserve(strs.size() + bytes, strs.CharCount() + chars);
+		std::vector<std::pair<PoolIndex, PoolIndex>> suffixes;//(后缀的字符索引, 字符串id)，和put的插入顺序一致
+		suffixes.reserve(logic == Logic::CONTAIN ? chars : keywords.size());
+		for (const std::string_view& keyword : keywords) {
+			size_t pos = strs.put(keyword);
+			size_t end = logic == Logic::CONTAIN ? strs.getLastStrSize() : 1;
+			for (size_t i = 0; i < end; i++) {
+				suffixes.emplace_back(static_cast<PoolIndex>(pos + i), static_cast<PoolIndex>(pos));
+			}
+		}
+		size_t next = 0;
+		//根节点还是NDense/NSlice时没法按首字符拆分，逐个插入直到它升级
+		for (; next < suffixes.size() && GetNodeType(root) != NodeType::MAP && GetNodeType(root) != NodeType::ACC; next++) {
+			PutChild(root, suffixes[next].first, suffixes[next].second);
+		}
+		if (next == suffixes.size()) {
+			return;
+		}
+		if (GetNodeType(root) == NodeType::MAP) {
+			NMapPool[GetNodeIndex(root)].init();//只插入过空字符串的NMap还没有子节点表
+		}
+		const std::unordered_map<uint32_t, NodeHandle>& RootChildren = GetNodeType(root) == NodeType::MAP
+			? *NMapPool[GetNodeIndex(root)].children : *NAccPool[GetNodeIndex(root)].NodeMap.children;
+		struct Bucket {
+			uint32_t ch;
+			std::vector<std::pair<PoolIndex, PoolIndex>> items;
+			TreeSearcher* shard = nullptr;
+			NodeHandle sub = 0;
+		};
+		std::vector<Bucket> buckets;//根节点下还没有的首字符，按第一次出现的顺序
+		std::unordered_map<uint32_t, size_t> BucketIndex;
+		std::vector<std::pair<PoolIndex, PoolIndex>> existing;//落在已有子节点或者根节点叶子上的，由调用线程插入
+		for (; next < suffixes.size(); next++) {
+			const auto& item = suffixes[next];
+			if (strs.end(item.first)) {
+				existing.push_back(item);
+				continue;
+			}
+			const uint32_t ch = strs.getcharFourCC(item.first);
+			if (RootChildren.contains(ch)) {
+				existing.push_back(item);
+				continue;
+			}
+			auto [it, inserted] = BucketIndex.try_emplace(ch, buckets.size());
+			if (inserted) {
+				buckets.push_back(Bucket{ ch, {} });
+			}
+			buckets[it->second].items.push_back(item);
+		}
+		suffixes = std::vector<std::pair<PoolIndex, PoolIndex>>();//已经分好组了，提前释放
+		std::vector<std::unique_ptr<TreeSearcher>> shards;
+		shards.reserve(pool.size());
+		for (size_t i = 0; i < pool.size(); i++) {
+			shards.push_back(std::unique_ptr<TreeSearcher>(new TreeSearcher(ShardTag{}, *this)));
+		}
+		WorkStealingPool::TaskGroup group;
+		for (Bucket& b : buckets) {
+			pool.submit(group, [&b, &shards, &pool]() {
+				TreeSearcher& shard = *shards[pool.WorkerIndex()];
+				b.shard = &shard;
+				b.sub = shard.NewDense();//和NMap::put新建子节点一致
+				for (const auto& [keyword, id] : b.items) {
+					shard.PutChild(b.sub, keyword + 1, id);
+				}
+			});
+		}
+		try {
+			//分片树只读字符串池，根节点和已有的子树只有调用线程在改，可以同时进行
+			for (const auto& [keyword, id] : existing) {
+				PutChild(root, keyword, id);
+			}
+		}
+		catch (...) {
+			try {
+				pool.wait(group);//任务还引用着buckets和shards
+			}
+			catch (...) {}
+			throw;
+		}
+		pool.wait(group);
+		for (Bucket& b : buckets) {
+			AttachRootChild(b.ch, adopt(*b.shard, b.sub));
+		}
+	}
+
+	TreeSearcher::NodeHandle TreeSearcher::adopt(TreeSearcher& shard, NodeHandle n) {
+		const uint32_t i = GetNodeIndex(n);
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE:
+			return MakeHandle(NodeType::DENSE, NDensePool.NewObj(std::move(shard.NDensePool[i])));
+		case NodeType::SLICE: {
+			NSlice& node = shard.NSlicePool[i];
+			node.exit_node = adopt(shard, node.exit_node);
+			return MakeHandle(NodeType::SLICE, NSlicePool.NewObj(node));
+		}
+		case NodeType::MAP: {
+			NMap& node = shard.NMapPool[i];
+			if (node.children != nullptr) {
+				for (auto& [c, child] : *node.children) {
+					child = adopt(shard, child);
+				}
+			}
+			return MakeHandle(NodeType::MAP, NMapPool.NewObj(std::move(node)));
+		}
+		case NodeType::ACC: {
+			NAcc& node = shard.NAccPool[i];
+			for (auto& [c, child] : *node.NodeMap.children) {
+				child = adopt(shard, child);
+			}
+			NodeHandle result = MakeHandle(NodeType::ACC, NAccPool.NewObj(std::move(node)));
+			naccs.push_back(GetNodeIndex(result));
+			return result;
+		}
+		}
+		return n;
+	}
+
+	void TreeSearcher::AttachRootChild(uint32_t ch, NodeHandle child) {
+		const uint32_t i = GetNodeIndex(root);
+		if (GetNodeType(root) == NodeType::MAP) {
+			NMap& node = NMapPool[i];
+			node.put(ch, child);
+			if (node.children->size() > NMapThreshold) {
+				NodeHandle result = NewAcc(node);
+				FreeNode(root);
+				root = result;
+			}
+		}
+		else {
+			NAcc& node = NAccPool[i];
+			node.NodeMap.put(ch, child);
+			node.index(*this, ch);
+		}
+	}
+
+	TreeSearcher::NodeHandle TreeSearcher::put(NodeHandle n, size_t keyword, size_t id) {
+		const uint32_t i = GetNodeIndex(n);
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE:
+			return NDensePool[i].put(*this, n, keyword, id);
+		case NodeType::SLICE:
+			return NSlicePool[i].put(*this, n, keyword, id);
+		case NodeType::MAP:
+			return NMapPool[i].put(*this, n, keyword, id);
+		case NodeType::ACC:
+			return NAccPool[i].put(*this, n, keyword, id);
+		}
+		return n;
+	}
+
+	void TreeSearcher::FreeNode(NodeHandle n) {
+		const uint32_t i = GetNodeIndex(n);
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE:
+			NDensePool.FreeToPool(i);
+			break;
+		case NodeType::SLICE:
+			NSlicePool.FreeToPool(i);
+			break;
+		case NodeType::MAP:
+			NMapPool.FreeToPool(i);
+			break;
+		case NodeType::ACC://插入时NAcc不会被替换，只有Compact的降级和FreeTree会回收，之后由CollectAccs重建naccs
+			break;
+		}
+	}
+
+	TreeSearcher::NodeHandle TreeSearcher::NewAcc(NMap& src) {
+		NodeHandle result = MakeHandle(NodeType::ACC, NAccPool.NewObj(*this, src));
+		naccs.push_back(GetNodeIndex(result));
+		return result;
+	}
+
 	std::vector<std::string> TreeSearcher::ExecuteSearch(const std::string_view& s) {
-		std::unordered_set<size_t> ret;
+		PININCPP_STATS_SCOPE(stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(s, ret);
+		return CollectStr(ret);
+	}
+
+	std::vector<std::string_view> TreeSearcher::ExecuteSearchView(const std::string_view& s) {
+		PININCPP_STATS_SCOPE(stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(s, ret);
+		return CollectStrView(ret);
+	}
+
+	std::unordered_set<PoolIndex> TreeSearcher::ExecuteSearchGetSet(const std::string_view& s) {
+		PININCPP_STATS_SCOPE(stats, s, collector.get());
+		std::vector<PoolIndex> ret;
 		CommonSearch(s, ret);
+		return std::unordered_set<PoolIndex>(ret.begin(), ret.end(), ret.size());
+	}
+
+	std::vector<std::string> TreeSearcher::ExecuteSearch(SearchContext& ctx, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(ctx.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(ctx, s, ret);
+		return CollectStr(ret);
+	}
+
+	std::vector<std::string_view> TreeSearcher::ExecuteSearchView(SearchContext& ctx, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(ctx.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(ctx, s, ret);
+		return CollectStrView(ret);
+	}
+
+	std::unordered_set<PoolIndex> TreeSearcher::ExecuteSearchGetSet(SearchContext& ctx, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(ctx.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(ctx, s, ret);
+		return std::unordered_set<PoolIndex>(ret.begin(), ret.end(), ret.size());
+	}
+
+	void TreeSearcher::ExecuteSearchStream(const std::string_view& s, const Callback& callback) {
+		PININCPP_STATS_SCOPE(stats, s, collector.get());
+		StreamSink sink(*this, seen, callback);
+		CommonSearch(s, sink);
+	}
+
+	void TreeSearcher::ExecuteSearchStream(SearchContext& ctx, const std::string_view& s, const Callback& callback)const {
+		PININCPP_STATS_SCOPE(ctx.stats, s, collector.get());
+		StreamSink sink(*this, ctx.seen, callback);
+		CommonSearch(ctx, s, sink);
+	}
+
+	void TreeSearcher::ExecuteSearchStream(SearchSession& session, const std::string_view& s, const Callback& callback)const {
+		PININCPP_STATS_SCOPE(session.stats, s, collector.get());
+		StreamSink sink(*this, session.seen, callback);
+		CommonSearch(session, s, sink);
+	}
+
+	std::vector<std::string> TreeSearcher::ExecuteSearch(SearchSession& session, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(session.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(session, s, ret);
+		return CollectStr(ret);
+	}
+
+	std::vector<std::string_view> TreeSearcher::ExecuteSearchView(SearchSession& session, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(session.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(session, s, ret);
+		return CollectStrView(ret);
+	}
+
+	std::unordered_set<PoolIndex> TreeSearcher::ExecuteSearchGetSet(SearchSession& session, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(session.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(session, s, ret);
+		return std::unordered_set<PoolIndex>(ret.begin(), ret.end(), ret.size());
+	}
+
+	std::vector<std::string> TreeSearcher::ExecuteSearch(ParallelContext& ctx, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(ctx.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(ctx, s, ret);
+		return CollectStr(ret);
+	}
+
+	std::vector<std::string_view> TreeSearcher::ExecuteSearchView(ParallelContext& ctx, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(ctx.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(ctx, s, ret);
+		return CollectStrView(ret);
+	}
+
+	std::unordered_set<PoolIndex> TreeSearcher::ExecuteSearchGetSet(ParallelContext& ctx, const std::string_view& s)const {
+		PININCPP_STATS_SCOPE(ctx.stats, s, collector.get());
+		std::vector<PoolIndex> ret;
+		CommonSearch(ctx, s, ret);
+		return std::unordered_set<PoolIndex>(ret.begin(), ret.end(), ret.size());
+	}
 
+	void TreeSearcher::CommonSearch(ParallelContext& ctx, const std::string_view& s, std::vector<PoolIndex>& ret)const {
+		if (&ctx.tree != this) {
+			throw std::invalid_argument("ParallelContext belongs to another TreeSearcher");
+		}
+		ctx.ticket->renew();
+		for (const auto& w : ctx.workers) {
+			w->acc.search(s);
+			if (logic != Logic::EQUAL) {
+				//部分匹配的树在第一次经过密集节点后就一直处于部分匹配模式，各个工作线程的Accelerator先切换好，不依赖各自的搜索历史
+				w->acc.setPartial(true);
+			}
+#ifdef PININCPP_STATS
+			w->stats = SearchStats();
+#endif
+		}
+		PININCPP_STATS_MARK(PrepareNs);
+		ParallelContext::Worker& self = *ctx.workers[ctx.pool.WorkerIndex()];
+		WorkStealingPool::TaskGroup group;
+		std::vector<std::pair<uint32_t, size_t>> forks;
+		try {
+			{//调用线程只展开根节点，根节点自己的结果也在这里收集
+				IdSink sink(*this, self.seen, self.ids, true);
+				sink.forks = &forks;
+				if (frozen != nullptr) {
+					sink.ForkRoot = 0;
+					frozen->get(*this, self.acc, sink, 0, 0);
+				}
+				else {
+					sink.ForkRoot = root;
+					get(root, self.acc, sink, 0);
+				}
+			}
+			//任务比线程多几倍，负载不均时留给空闲线程窃取
+			const size_t TaskNum = std::min(forks.size(), ctx.pool.size() * 8);
+			for (size_t t = 0; t < TaskNum; t++) {
+				const size_t first = forks.size() * t / TaskNum;
+				const size_t last = forks.size() * (t + 1) / TaskNum;
+				ctx.pool.submit(group, [this, &ctx, &forks, first, last]() {
+					ParallelContext::Worker& w = *ctx.workers[ctx.pool.WorkerIndex()];
+					PININCPP_STATS_BIND(w.stats);//工作线程各自计数，结束后合并
+					IdSink sink(*this, w.seen, w.ids, true);
+					for (size_t k = first; k < last; k++) {
+						if (frozen != nullptr) {
+							frozen->get(*this, w.acc, sink, forks[k].first, forks[k].second);
+						}
+						else {
+							get(forks[k].first, w.acc, sink, forks[k].second);
+						}
+					}
+				});
+			}
+			ctx.pool.wait(group);
+			PININCPP_STATS_MARK(TraverseNs);
+		}
+		catch (...) {
+			try {
+				ctx.pool.wait(group);//已经提交的任务还引用着forks，等它们结束
+			}
+			catch (...) {}//只重新抛出第一个异常
+			for (const auto& w : ctx.workers) {
+				w->seen.clear();
+				w->ids.clear();
+			}
+			throw;
+		}
+		//用调用线程的位图合并，它已经包含了根节点的结果
+		ret = std::move(self.ids);
+		self.ids.clear();
+		for (const auto& w : ctx.workers) {
+			if (w.get() != &self) {
+				for (const PoolIndex id : w->ids) {
+					if (self.seen.insert(id)) {
+						ret.push_back(id);
+					}
+				}
+				w->seen.clear();
+				w->ids.clear();
+			}
+		}
+		self.seen.clear();
+#ifdef PININCPP_STATS
+		for (const auto& w : ctx.workers) {
+			ctx.stats.merge(w->stats);
+		}
+		ctx.stats.UniqueResults = ret.size();//各个工作线程只在自己的位图里去重，以合并后的为准
+#endif
+	}
+
+	void TreeSearcher::CommonSearch(SearchSession& session, const std::string_view& s, ResultSink& ret)const {
+		if (&session.tree != this) {
+			throw std::invalid_argument("SearchSession belongs to another TreeSearcher");
+		}
+		session.ticket->renew();
+		Accelerator& acc = session.acc;
+		//只有在旧查询后面追加字符时才能从边界继续，EQUAL要求整串相等，新增字符会让旧的匹配失效，不适用
+		bool resumable = session.valid && session.version == version && logic != Logic::EQUAL
+			&& !session.last.empty() && s.size() > session.last.size() && s.starts_with(session.last);
+		std::vector<FrontierEntry> frontier;
+		std::vector<FrontierEntry> old = std::move(session.frontier);
+		session.valid = false;//搜索中途抛出异常时不留下半成品边界
+		const size_t OldSize = acc.search().size();
+		acc.search(s);
+		if (logic != Logic::EQUAL) {
+			//边界的正确性依赖部分匹配模式，提前切换好，这也是非EQUAL树在第一次经过密集节点后的常态
+			acc.setPartial(true);
+			ret.frontier = &frontier;
+		}
+		PININCPP_STATS_MARK(PrepareNs);
+		if (resumable) {
+			for (const FrontierEntry& e : old) {
+				resume(e, acc, ret, OldSize);
+				if (ret.stopped()) {
+					break;
+				}
+			}
+		}
+		else if (frozen != nullptr) {
+			frozen->get(*this, acc, ret, 0, 0);
+		}
+		else {
+			get(root, acc, ret, 0);
+		}
+		ret.frontier = nullptr;
+		//同一条边可能经由NAcc的精确字符和音素索引记录两次
+		std::sort(frontier.begin(), frontier.end());
+		frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+		session.frontier = std::move(frontier);
+		session.last = std::string(s);
+		session.version = version;
+		session.valid = logic != Logic::EQUAL && !ret.stopped();
+		PININCPP_STATS_MARK(TraverseNs);
+	}
+
+	bool TreeSearcher::AccIndexPass(uint32_t ch, const Accelerator& acc, size_t offset)const {
+		//和NAcc::index的建立方式对应：字符的任意一个读音的首音素能匹配上，就会在音素索引里被选中
+		auto pass = [&acc, offset](const PinIn::Character& c) {
+			for (const auto& py : c.GetPinyins()) {
+				if (!py.GetPhonemes()[0].match(acc.searchAscii(), offset, true).empty()) {
+					return true;
+				}
+			}
+			return false;
+		};
+		const PinIn::Character* c = context->GetCharCachePtr(ch);
+		return c == nullptr ? pass(context->GetChar(ch)) : pass(*c);
+	}
+
+	void TreeSearcher::resume(const FrontierEntry& e, Accelerator& acc, ResultSink& ret, size_t OldSize)const {
+		if (e.kind == FrontierEntry::DENSE) {
+			if (frozen != nullptr) {
+				frozen->get(*this, acc, ret, e.node, e.offset);
+			}
+			else {
+				get(e.node, acc, ret, e.offset);
+			}
+			return;
+		}
+		if (e.kind == FrontierEntry::ACC_EXACT) {//原字符没变，这条边在新查询下依然只落在旧结尾
+			if (frozen != nullptr) {
+				frozen->get(*this, acc, ret, e.node, OldSize);
+			}
+			else {
+				get(e.node, acc, ret, OldSize);
+			}
+			return;
+		}
+		if (e.kind == FrontierEntry::ACC_INDEX && !AccIndexPass(e.ch, acc, e.offset)) {
+			return;//NAcc在新查询下不会再经过音素索引走这条边
+		}
+		//旧查询下这条边落在旧结尾，新查询下只有终点不早于旧结尾的转移是新的，更早的终点旧搜索里已经作为边界访问过了
+		IndexSet::IndexSetIterObj it = acc.get(e.ch, e.offset).GetIterObj();
+		for (uint32_t i = it.Next(); i != IndexSetIterEnd; i = it.Next()) {
+			const size_t next = e.offset + i;
+			if (next < OldSize) {
+				continue;
+			}
+			RecordLanding(ret, acc, e.kind, e.node, e.ch, e.offset, next, e.pos);
+			if (e.kind != FrontierEntry::SLICE_STEP) {
+				if (frozen != nullptr) {
+					frozen->get(*this, acc, ret, e.node, next);
+				}
+				else {
+					get(e.node, acc, ret, next);
+				}
+			}
+			else if (frozen != nullptr) {
+				frozen->GetSlice(*this, acc, ret, frozen->nodes[e.node], next, e.pos);
+			}
+			else {
+				NSlicePool[GetNodeIndex(e.node)].get(*this, acc, ret, next, e.pos, e.node);
+			}
+		}
+	}
+
+	//Top-K的接收方，用一个小根堆(堆顶是当前第k名)维护前k个结果，复用的位图去重，同一个id只打一次分
+	class TreeSearcher::TopKSink : public ResultSink {
+	public:
+		TopKSink(const TreeSearcher& p, SeenIds& seen, size_t k, const Scorer& scorer, int64_t MaxScore)
+			:p{ p }, k{ k }, scorer{ scorer }, MaxScore{ MaxScore }, seen{ seen } {
+			seen.prepare(p);
+			heap.reserve(k);
+		}
+		~TopKSink() {
+			seen.clear();
+		}
+		virtual void insert(PoolIndex id) {
+			if (stop) {//节点只在进入时检查stop，密集节点和叶子集合会把剩下的id继续交过来，不再打分
+				return;
+			}
+			PININCPP_STAT(RawResults++);
+			if (!seen.insert(id)) {
+				return;
+			}
+			PININCPP_STAT(UniqueResults++);
+			Entry e{ scorer(id, p.GetStrViewById(id)), id };
+			if (heap.size() < k) {
+				heap.push_back(e);
+				std::push_heap(heap.begin(), heap.end(), Better);
+			}
+			else if (Better(e, heap.front())) {
+				std::pop_heap(heap.begin(), heap.end(), Better);
+				heap.back() = e;
+				std::push_heap(heap.begin(), heap.end(), Better);
+			}
+			//第k名都已经达到MaxScore，剩下的结果分数不可能更高，最多只是并列(默认打分是同在第一档)
+			//并列的里面可能有排名更靠前的，但为了它们继续遍历就失去了提前结束的意义，所以上界处的并列按遍历顺序取舍
+			if (heap.size() == k && heap.front().score >= MaxScore) {
+				stop = true;
+			}
+		}
+		std::vector<std::string> result() {
+			std::sort_heap(heap.begin(), heap.end(), Better);
+			std::vector<std::string> result;
+			result.reserve(heap.size());
+			for (const Entry& e : heap) {
+				result.emplace_back(p.GetStrViewById(e.id));
+			}
+			return result;
+		}
+	private:
+		struct Entry {
+			int64_t score;
+			PoolIndex id;
+		};
+		static bool Better(const Entry& a, const Entry& b) noexcept {
+			return a.score != b.score ? a.score > b.score : a.id < b.id;
+		}
+		const TreeSearcher& p;
+		size_t k;
+		const Scorer& scorer;
+		int64_t MaxScore;
+		SeenIds& seen;
+		std::vector<Entry> heap;
+	};
+
+	//分数由高到低的三段：是否原文包含 | 出现位置 | 字符串长度，各段截断到能放下的宽度
+	static constexpr int64_t ScoreFieldBits = 20;
+	static constexpr int64_t ScoreFieldMax = (static_cast<int64_t>(1) << ScoreFieldBits) - 1;
+	//第一档是原文以搜索串开头的条目，位置段为0，只差长度段，出现位置更靠后的条目分数一定更低
+	static constexpr int64_t DefaultTopTier = (static_cast<int64_t>(1) << (ScoreFieldBits * 2)) - ScoreFieldMax;
+
+	int64_t TreeSearcher::DefaultScore(const std::string_view& s, std::string_view str)noexcept {
+		const int64_t length = static_cast<int64_t>(std::min<size_t>(str.size(), ScoreFieldMax));
+		const size_t pos = s.empty() ? std::string_view::npos : str.find(s);
+		if (pos == std::string_view::npos) {
+			return -length;
+		}
+		const int64_t position = static_cast<int64_t>(std::min<size_t>(pos, ScoreFieldMax));
+		return ((static_cast<int64_t>(1) << (ScoreFieldBits * 2)) - (position << ScoreFieldBits)) - length;
+	}
+
+	template<typename SearchFunc>
+	std::vector<std::string> TreeSearcher::CommonTopK(SeenIds& seen, const std::string_view& s, size_t k, const Scorer& scorer, int64_t MaxScore, SearchFunc&& search)const {
+		if (k == 0) {
+			return {};
+		}
+		Scorer DefaultScorer;
+		if (scorer == nullptr) {
+			DefaultScorer = [&s](PoolIndex, std::string_view str) {
+				return DefaultScore(s, str);
+			};
+			MaxScore = DefaultTopTier;//前k名都进入第一档后提前结束
+		}
+		TopKSink sink(*this, seen, k, scorer == nullptr ? DefaultScorer : scorer, MaxScore);
+		search(sink);
+		return sink.result();
+	}
+
+	std::vector<std::string> TreeSearcher::ExecuteSearchTopK(const std::string_view& s, size_t k, const Scorer& scorer, int64_t MaxScore) {
+		PININCPP_STATS_SCOPE(stats, s, collector.get());
+		ticket->renew();//CommonTopK是const的，先在这里刷新
+		return CommonTopK(seen, s, k, scorer, MaxScore, [this, &s](ResultSink& sink) {
+			CommonSearch(acc, s, sink);
+		});
+	}
+
+	std::vector<std::string> TreeSearcher::ExecuteSearchTopK(SearchContext& ctx, const std::string_view& s, size_t k, const Scorer& scorer, int64_t MaxScore)const {
+		PININCPP_STATS_SCOPE(ctx.stats, s, collector.get());
+		return CommonTopK(ctx.seen, s, k, scorer, MaxScore, [this, &ctx, &s](ResultSink& sink) {
+			CommonSearch(ctx, s, sink);
+		});
+	}
+
+	std::vector<std::string> TreeSearcher::CollectStr(const std::vector<PoolIndex>& ret)const {
 		std::vector<std::string> result;
 		result.reserve(ret.size());
-		for (const size_t id : ret) {//基本类型复制更高效
+		for (const PoolIndex id : ret) {//基本类型复制更高效
 			result.emplace_back(strs.getstr(id));
 		}
 		return result;
 	}
 
-	std::vector<std::string_view> TreeSearcher::ExecuteSearchView(const std::string_view& s) {
-		std::unordered_set<size_t> ret;
-		CommonSearch(s, ret);
-
+	std::vector<std::string_view> TreeSearcher::CollectStrView(const std::vector<PoolIndex>& ret)const {
 		std::vector<std::string_view> result;
 		result.reserve(ret.size());
-		for (const size_t id : ret) {//基本类型复制更高效
+		for (const PoolIndex id : ret) {//基本类型复制更高效
 			result.emplace_back(strs.getstr_view(id));
 		}
 		return result;
 	}
 
-	std::unordered_set<size_t> TreeSearcher::ExecuteSearchGetSet(const std::string_view& s) {
-		std::unordered_set<size_t> ret;
-		CommonSearch(s, ret);
-		return ret;
-	}
-
-	void TreeSearcher::NDense::get(TreeSearcher& p, std::unordered_set<size_t>& ret, size_t offset) {
+	void TreeSearcher::NDense::get(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, size_t offset)const {
 		bool full = p.logic == Logic::EQUAL;
-		if (!full && p.acc.search().size() == offset) {
+		if (!full && acc.search().size() == offset) {
 			get(p, ret);
 		}
 		else {
 			for (size_t i = 0; i < data.size(); i += 2) {
 				size_t ch = data[i];
-				if (full ? p.acc.matches(offset, ch) : p.acc.begins(offset, ch)) {
+				if (full ? acc.matches(offset, ch) : acc.begins(offset, ch)) {
 					ret.insert(data[i + 1]);
 				}
 			}
 		}
 	}
 
-	void TreeSearcher::NDense::get(TreeSearcher& p, std::unordered_set<size_t>& ret) {
+	void TreeSearcher::NDense::get(const TreeSearcher&, ResultSink& ret)const {//参数和其他节点的get保持一致，密集节点自己就存着全部id，用不到树
 		for (size_t i = 1; i < data.size(); i += 2) {
 			ret.insert(data[i]);
 		}
 	}
 
-	TreeSearcher::Node* TreeSearcher::NDense::put(TreeSearcher& p, size_t keyword, size_t id) {
+	TreeSearcher::NodeHandle TreeSearcher::NDense::put(TreeSearcher& p, NodeHandle self, size_t keyword, size_t id) {
 		if (data.size() >= TreeSearcher::NDenseThreshold) {
 			size_t pattern = data[0];
-			std::unique_ptr<Node> result = p.NSlicePool.NewObj(p, pattern, pattern + match(p));
-			Node* other = result.get();
+			//分块竞技场扩容不会移动已有对象，所以新建节点后this依然有效
+			NodeHandle result = p.NewSlice(pattern, pattern + match(p), p.NewMap());
 			for (size_t j = 0; j < data.size(); j += 2) {
-				other = result->put(p, data[j], data[j + 1]);
-				if (other != result.get()) {//节点升级
-					p.NodeOwnershipReset(result, other);
-					//因为other本质上已经是新指针了，所以不用再次赋值。result通过这个转移所有权的函数现在他和other是同一个指针
-				}
-			}
-			other = result->put(p, keyword, id);
-			if (other != result.get()) {//节点升级
-				p.NodeOwnershipReset(result, other);
+				p.PutChild(result, data[j], data[j + 1]);//节点升级时result会被替换为新句柄
 			}
-			return result.release();
+			p.PutChild(result, keyword, id);
+			return result;
 		}
 		else {
-			data.emplace_back(keyword);
-			data.emplace_back(id);
-			return this;
+			data.emplace_back(static_cast<PoolIndex>(keyword));
+			data.emplace_back(static_cast<PoolIndex>(id));
+			return self;
 		}
 	}
 
 	size_t TreeSearcher::NDense::match(const TreeSearcher& p)const {//这个函数内，是不会put的，可以实现零拷贝设计
 		for (size_t i = 0; ; i++) {
-			if (p.strs.end(data[0] + i)) {//空检查置前，避免额外的字符串构造和std::string比较。而且end实际上比较的是字节，所以速度会更快
+			if (p.keys->end(data[0] + i)) {//空检查置前，避免额外的字符串构造和std::string比较。而且end实际上比较的是字节，所以速度会更快
 				return i;
 			}
 			size_t aIndex = data[0] + i;
 			for (size_t j = 2; j < data.size(); j += 2) {//跳过第一个元素
-				if (!p.strs.EqualChar(aIndex, data[j] + i)) {
+				if (!p.keys->EqualChar(aIndex, data[j] + i)) {
 					return i;
 				}
 			}
 		}
 	}
 
-	void TreeSearcher::NAcc::get(TreeSearcher& p, std::unordered_set<size_t>& result, size_t offset) {
-		if (p.acc.search().size() == offset) {
+	void TreeSearcher::NAcc::get(const TreeSearcher& p, Accelerator& acc, ResultSink& result, size_t offset)const {
+		if (acc.search().size() == offset) {
 			if (p.logic == Logic::EQUAL) {
-				NodeMap.leaves.AddToSTLSet(result);
+				NodeMap.leaves.AddToSink(result);
 			}
 			else {
 				NodeMap.get(p, result);//直接调用原始的这个，避免中间层开销
 			}
 		}
 		else {
-			auto it = NodeMap.children->find(p.acc.searchU32FourCC(offset));
+			auto it = NodeMap.children->find(acc.searchU32FourCC(offset));
 			if (it != NodeMap.children->end()) {
-				it->second->get(p, result, offset + 1);
+				RecordLanding(result, acc, FrontierEntry::ACC_EXACT, it->second, it->first, offset, offset + 1);
+				p.get(it->second, acc, result, offset + 1);
 			}
 			for (const auto& [k, v] : index_node) {
-				if (!k.match(p.acc.search(), offset, true).empty()) {
-					std::unordered_map<uint32_t, std::unique_ptr<Node>>& map = *NodeMap.children;
+				if (!k.match(acc.searchAscii(), offset, true).empty()) {
+					const std::unordered_map<uint32_t, NodeHandle>& map = *NodeMap.children;
 					for (const auto& c : v) {
-						IndexSet::IndexSetIterObj it = p.acc.get(c, offset).GetIterObj();
+						IndexSet::IndexSetIterObj it = acc.get(c, offset).GetIterObj();
+						const NodeHandle n = map.find(c)->second;//索引是由children构建的，一定存在
 						for (uint32_t j = it.Next(); j != IndexSetIterEnd; j = it.Next()) {
-							map[c]->get(p, result, offset + j);
+							RecordLanding(result, acc, FrontierEntry::ACC_INDEX, n, c, offset, offset + j);
+							p.get(n, acc, result, offset + j);
 						}
 					}
 				}
@@ -161,51 +790,902 @@ namespace PinInCpp {
 		}
 	}
 
-	TreeSearcher::Node* TreeSearcher::NSlice::put(TreeSearcher& p, size_t keyword, size_t id) {
+	TreeSearcher::NodeHandle TreeSearcher::NSlice::put(TreeSearcher& p, NodeHandle self, size_t keyword, size_t id) {
 		size_t length = end - start;
 		size_t match = p.acc.common(start, keyword, length);
-		Node* n;
 		if (match >= length) {
-			n = exit_node->put(p, keyword + length, id);
+			p.PutChild(exit_node, keyword + length, id);
 		}
 		else {
 			cut(p, start + match);
-			n = exit_node->put(p, keyword + match, id);
-		}
-		if (exit_node.get() != n) {
-			p.NodeOwnershipReset(exit_node, n);
+			p.PutChild(exit_node, keyword + match, id);
 		}
-		return start == end ? exit_node.release() : this;
+		return start == end ? exit_node : self;//切片为空时由出口节点替代自身，自身由调用方回收
 	}
 
 	void TreeSearcher::NSlice::cut(TreeSearcher& p, size_t offset) {
-		std::unique_ptr<NMap> insert = p.NMapPool.NewObj();//保证异常安全
-		if (offset + 1 == end) {//当前exit_node的所有权都会被转移
-			insert->put(p.strs.getcharFourCC(offset), std::move(exit_node));
+		NodeHandle insert = p.NewMap();
+		if (offset + 1 == end) {//当前exit_node直接挂到新的NMap下
+			p.NMapPool[GetNodeIndex(insert)].put(p.keys->getcharFourCC(offset), exit_node);
 		}
-		else {
-			std::unique_ptr<NSlice> half = p.NSlicePool.NewObj(p, offset + 1, end);
-			half->exit_node = std::move(exit_node);
-			insert->put(p.strs.getcharFourCC(offset), std::move(half));
+		else {//剩余部分由新的切片接管exit_node
+			NodeHandle half = p.NewSlice(offset + 1, end, exit_node);
+			p.NMapPool[GetNodeIndex(insert)].put(p.keys->getcharFourCC(offset), half);
 		}
-		exit_node = std::move(insert);
-		end = offset;
+		exit_node = insert;
+		end = static_cast<PoolIndex>(offset);
 	}
 
-	void TreeSearcher::NSlice::get(TreeSearcher& p, std::unordered_set<size_t>& ret, size_t offset, size_t start) {
+	void TreeSearcher::NSlice::get(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, size_t offset, size_t start, NodeHandle self)const {
 		if (this->start + start == end) {
-			exit_node->get(p, ret, offset);
+			p.get(exit_node, acc, ret, offset);
 		}
-		else if (offset == p.acc.search().size()) {
+		else if (offset == acc.search().size()) {
 			if (p.logic != Logic::EQUAL) {
-				exit_node->get(p, ret);
+				p.get(exit_node, ret);
 			}
 		}
 		else {
 			uint32_t ch = p.strs.getcharFourCC(this->start + start);
-			IndexSet::IndexSetIterObj it = p.acc.get(ch, offset).GetIterObj();
+			IndexSet::IndexSetIterObj it = acc.get(ch, offset).GetIterObj();
+			for (uint32_t i = it.Next(); i != IndexSetIterEnd; i = it.Next()) {
+				RecordLanding(ret, acc, FrontierEntry::SLICE_STEP, self, ch, offset, offset + i, start + 1);
+				get(p, acc, ret, offset + i, start + 1, self);
+			}
+		}
+	}
+
+	void TreeSearcher::Freeze() {
+		if (frozen != nullptr) {
+			return;
+		}
+		ticket->renew();
+		frozen = std::make_unique<FrozenTree>(*this, root);
+		version++;//节点的编号方式变了
+		//构建期的节点全部释放，之后只保留压平的数组
+		NDensePool.clear();
+		NSlicePool.clear();
+		NMapPool.clear();
+		NAccPool.clear();
+		naccs.clear();
+		naccs.shrink_to_fit();
+		strs.ShrinkToFit();
+	}
+
+	TreeSearcher::FrozenTree::FrozenTree(const TreeSearcher& p, NodeHandle root) {
+		emit(p, root);
+		nodes.shrink_to_fit();
+		DenseKeys.shrink_to_fit();
+		Ids.shrink_to_fit();
+		ChildChars.shrink_to_fit();
+		ChildNodes.shrink_to_fit();
+		accs.shrink_to_fit();
+		reload(p);
+	}
+
+	uint32_t TreeSearcher::FrozenTree::emit(const TreeSearcher& p, NodeHandle h) {
+		if (nodes.size() >= UINT32_MAX) {
+			throw std::length_error("FrozenTree node count exceeds the capacity of uint32_t");
+		}
+		const uint32_t self = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();//先占位保证先序，子节点递归时nodes会扩容，所以不持有引用
+		Node n{};
+		n.type = GetNodeType(h);
+		n.IdsBegin = static_cast<PoolIndex>(Ids.size());
+		const uint32_t i = GetNodeIndex(h);
+		switch (n.type) {
+		case NodeType::DENSE: {
+			const std::vector<PoolIndex>& data = p.NDensePool[i].data;
+			n.start = static_cast<PoolIndex>(DenseKeys.size());
+			for (size_t j = 0; j < data.size(); j += 2) {
+				DenseKeys.push_back(data[j]);
+				Ids.push_back(data[j + 1]);
+			}
+			n.end = static_cast<PoolIndex>(DenseKeys.size());
+			n.OwnEnd = static_cast<PoolIndex>(Ids.size());
+			break;
+		}
+		case NodeType::SLICE: {
+			const NSlice& slice = p.NSlicePool[i];
+			n.start = slice.start;
+			n.end = slice.end;
+			n.OwnEnd = n.IdsBegin;
+			n.ChildBegin = emit(p, slice.exit_node);
+			break;
+		}
+		case NodeType::MAP:
+			EmitMap(p, p.NMapPool[i], n);
+			break;
+		case NodeType::ACC:
+			EmitMap(p, p.NAccPool[i].NodeMap, n);
+			n.acc = static_cast<uint32_t>(accs.size());
+			accs.push_back(AccIndex{ self, {} });
+			break;
+		}
+		n.IdsEnd = static_cast<PoolIndex>(Ids.size());
+		nodes[self] = n;
+		return self;
+	}
+
+	template<bool CanUpgrade>
+	void TreeSearcher::FrozenTree::EmitMap(const TreeSearcher& p, const NMapTemplate<CanUpgrade>& m, Node& n) {
+		std::unordered_set<PoolIndex> leaves;
+		m.leaves.AddToSTLSet(leaves);
+		size_t LeafStart = Ids.size();
+		Ids.insert(Ids.end(), leaves.begin(), leaves.end());
+		std::sort(Ids.begin() + LeafStart, Ids.end());
+		n.OwnEnd = static_cast<PoolIndex>(Ids.size());
+
+		std::vector<std::pair<uint32_t, NodeHandle>> children;
+		if (m.children != nullptr) {
+			children.assign(m.children->begin(), m.children->end());
+			std::sort(children.begin(), children.end());//按字符排序，精确查找时可以二分
+		}
+		n.ChildBegin = static_cast<uint32_t>(ChildChars.size());
+		for (const auto& [c, h] : children) {
+			ChildChars.push_back(c);
+			ChildNodes.push_back(0);
+		}
+		n.ChildEnd = static_cast<uint32_t>(ChildChars.size());
+		for (size_t k = 0; k < children.size(); k++) {//子节点的区间先整体占好，再逐个递归展开
+			uint32_t child = emit(p, children[k].second);
+			ChildNodes[n.ChildBegin + k] = child;
+		}
+	}
+
+	void TreeSearcher::FrozenTree::reload(const TreeSearcher& p) {
+		for (AccIndex& a : accs) {
+			const Node& n = nodes[a.node];
+			std::unordered_map<PinIn::Phoneme, std::vector<uint32_t>> index;
+			for (uint32_t k = n.ChildBegin; k < n.ChildEnd; k++) {
+				auto IndexChar = [&index, k](const PinIn::Character& ch) {
+					for (const auto& py : ch.GetPinyins()) {
+						std::vector<uint32_t>& v = index[py.GetPhonemes()[0]];
+						if (v.empty() || v.back() != k) {//同一个字的多个读音可能有相同的首音素
+							v.push_back(k);
+						}
+					}
+				};
+				const PinIn::Character* ch = p.context->GetCharCachePtr(ChildChars[k]);
+				if (ch == nullptr) {
+					IndexChar(p.context->GetChar(ChildChars[k]));
+				}
+				else {
+					IndexChar(*ch);
+				}
+			}
+			a.phonemes.clear();
+			a.phonemes.reserve(index.size());
+			for (auto& [ph, v] : index) {
+				v.shrink_to_fit();
+				a.phonemes.emplace_back(ph, std::move(v));
+			}
+		}
+	}
+
+	size_t TreeSearcher::FrozenTree::MemoryUsage()const noexcept {
+		size_t bytes = sizeof(FrozenTree) + HeapBytes(nodes) + HeapBytes(DenseKeys) + HeapBytes(Ids)
+			+ HeapBytes(ChildChars) + HeapBytes(ChildNodes) + HeapBytes(accs);
+		for (const AccIndex& a : accs) {
+			bytes += HeapBytes(a.phonemes);
+			for (const auto& [ph, v] : a.phonemes) {
+				bytes += ph.MemoryUsage() + HeapBytes(v);
+			}
+		}
+		return bytes;
+	}
+
+	void TreeSearcher::FrozenTree::get(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, uint32_t idx, size_t offset)const {
+		if (ret.stopped()) {
+			return;
+		}
+		if (ret.forks != nullptr && idx != ret.ForkRoot) {
+			ret.forks->emplace_back(idx, offset);
+			return;
+		}
+		const Node& n = nodes[idx];
+		switch (n.type) {
+		case NodeType::DENSE: {
+			PININCPP_STAT(DenseNodes++);
+			if (ret.frontier != nullptr && offset < acc.search().size()) {
+				ret.frontier->push_back(FrontierEntry{ FrontierEntry::DENSE, idx, 0, 0, offset });
+			}
+			bool full = p.logic == Logic::EQUAL;
+			if (!full && acc.search().size() == offset) {
+				CollectOwn(n, ret);
+			}
+			else {
+				for (PoolIndex i = n.start; i < n.end; i++) {
+					size_t ch = DenseKeys[i];
+					if (full ? acc.matches(offset, ch) : acc.begins(offset, ch)) {
+						ret.insert(Ids[n.IdsBegin + (i - n.start)]);
+					}
+				}
+			}
+			break;
+		}
+		case NodeType::SLICE:
+			PININCPP_STAT(SliceNodes++);
+			GetSlice(p, acc, ret, n, offset, 0);
+			break;
+		case NodeType::MAP:
+		case NodeType::ACC:
+			if (n.type == NodeType::MAP) {
+				PININCPP_STAT(MapNodes++);
+			}
+			else {
+				PININCPP_STAT(AccNodes++);
+			}
+			if (acc.search().size() == offset) {
+				if (p.logic == Logic::EQUAL) {
+					CollectOwn(n, ret);
+				}
+				else {
+					CollectAll(n, ret);
+				}
+			}
+			else if (n.type == NodeType::MAP) {
+				for (uint32_t k = n.ChildBegin; k < n.ChildEnd; k++) {
+					IndexSet::IndexSetIterObj it = acc.get(ChildChars[k], offset).GetIterObj();
+					for (uint32_t i = it.Next(); i != IndexSetIterEnd; i = it.Next()) {
+						RecordLanding(ret, acc, FrontierEntry::MOVE, ChildNodes[k], ChildChars[k], offset, offset + i);
+						get(p, acc, ret, ChildNodes[k], offset + i);
+					}
+				}
+			}
+			else {
+				auto first = ChildChars.begin() + n.ChildBegin;
+				auto last = ChildChars.begin() + n.ChildEnd;
+				auto it = std::lower_bound(first, last, acc.searchU32FourCC(offset));
+				if (it != last && *it == acc.searchU32FourCC(offset)) {
+					RecordLanding(ret, acc, FrontierEntry::ACC_EXACT, ChildNodes[it - ChildChars.begin()], *it, offset, offset + 1);
+					get(p, acc, ret, ChildNodes[it - ChildChars.begin()], offset + 1);
+				}
+				for (const auto& [ph, ks] : accs[n.acc].phonemes) {
+					if (!ph.match(acc.searchAscii(), offset, true).empty()) {
+						for (const uint32_t k : ks) {
+							IndexSet::IndexSetIterObj iter = acc.get(ChildChars[k], offset).GetIterObj();
+							for (uint32_t j = iter.Next(); j != IndexSetIterEnd; j = iter.Next()) {
+								RecordLanding(ret, acc, FrontierEntry::ACC_INDEX, ChildNodes[k], ChildChars[k], offset, offset + j);
+								get(p, acc, ret, ChildNodes[k], offset + j);
+							}
+						}
+					}
+				}
+			}
+			break;
+		}
+	}
+
+	void TreeSearcher::FrozenTree::GetSlice(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, const Node& n, size_t offset, size_t start)const {
+		if (n.start + start == n.end) {
+			get(p, acc, ret, n.ChildBegin, offset);
+		}
+		else if (offset == acc.search().size()) {
+			if (p.logic != Logic::EQUAL) {
+				CollectAll(n, ret);//切片自身没有id，子树就是出口节点的子树
+			}
+		}
+		else {
+			uint32_t ch = p.strs.getcharFourCC(n.start + start);
+			IndexSet::IndexSetIterObj it = acc.get(ch, offset).GetIterObj();
 			for (uint32_t i = it.Next(); i != IndexSetIterEnd; i = it.Next()) {
-				get(p, ret, offset + i, start + 1);
+				RecordLanding(ret, acc, FrontierEntry::SLICE_STEP, static_cast<uint32_t>(&n - nodes.data()), ch, offset, offset + i, start + 1);
+				GetSlice(p, acc, ret, n, offset + i, start + 1);
+			}
+		}
+	}
+
+	void TreeSearcher::ForEachStr(const std::function<void(std::string_view str)>& callback)const {
+		for (size_t id = 0; id < strs.CharCount();) {
+			const size_t end = StrEnd(id);
+			if (!IsErased(id)) {
+				callback(strs.getrange_view(id, end));
+			}
+			id = end + 1;
+		}
+	}
+
+	TreeSearcher::MemoryReport TreeSearcher::MemoryUsage()const {
+		MemoryReport result;
+		result.strs = strs.MemoryUsage();
+		auto ChildrenBytes = [](const std::unique_ptr<std::unordered_map<uint32_t, NodeHandle>>& children) {
+			return children == nullptr ? 0 : sizeof(*children) + HeapBytes(*children);
+		};
+		NDensePool.ForEach([&result](const NDense& n) {
+			result.DenseNodes.count++;
+			result.DenseNodes.bytes += sizeof(NDense) + HeapBytes(n.data);
+		});
+		NSlicePool.ForEach([&result](const NSlice&) {
+			result.SliceNodes.count++;
+			result.SliceNodes.bytes += sizeof(NSlice);
+		});
+		NMapPool.ForEach([&result, &ChildrenBytes](const NMap& n) {
+			result.MapNodes.count++;
+			result.MapNodes.bytes += sizeof(NMap) + ChildrenBytes(n.children);
+			result.ObjSets += n.leaves.MemoryUsage();
+		});
+		NAccPool.ForEach([&result, &ChildrenBytes](const NAcc& n) {
+			result.AccNodes.count++;
+			result.AccNodes.bytes += sizeof(NAcc) + ChildrenBytes(n.NodeMap.children);
+			result.ObjSets += n.NodeMap.leaves.MemoryUsage();
+			result.AccIndex += HeapBytes(n.index_node);
+			for (const auto& [ph, set] : n.index_node) {
+				result.AccIndex += ph.MemoryUsage() + HeapBytes(set);
+			}
+		});
+		//竞技场的全部字节减去存活节点本身，剩下的就是空闲和还没用到的部分
+		result.FreeLists = NDensePool.MemoryUsage() - NDensePool.LiveSize() * sizeof(NDense)
+			+ NSlicePool.MemoryUsage() - NSlicePool.LiveSize() * sizeof(NSlice)
+			+ NMapPool.MemoryUsage() - NMapPool.LiveSize() * sizeof(NMap)
+			+ NAccPool.MemoryUsage() - NAccPool.LiveSize() * sizeof(NAcc);
+		if (frozen != nullptr) {
+			result.frozen = frozen->MemoryUsage();
+		}
+		result.accelerator = acc.MemoryUsage();
+		result.other = seen.MemoryUsage() + HeapBytes(erased) + HeapBytes(naccs) + sizeof(PinIn::Ticket);
+		return result;
+	}
+
+	bool TreeSearcher::erase(size_t id) {
+		if (!IsEntry(id)) {
+			return false;
+		}
+		const size_t words = (strs.CharCount() + 63) / 64;
+		if (erased.size() < words) {
+			erased.resize(words);
+		}
+		erased[id / 64] |= static_cast<uint64_t>(1) << (id % 64);
+		ErasedChars += StrEnd(id) - id + 1;
+		return true;
+	}
+
+	size_t TreeSearcher::update(size_t id, const std::string_view& keyword) {
+		if (frozen != nullptr) {
+			throw std::logic_error("TreeSearcher is frozen");
+		}
+		if (!IsEntry(id)) {
+			throw std::invalid_argument("id is not a live entry of this TreeSearcher");
+		}
+		const size_t result = strs.CharCount();//put返回的首端索引就是插入前的字符数
+		put(keyword);
+		erase(id);
+		return result;
+	}
+
+	struct TreeSearcher::CompactState {
+		static constexpr PoolIndex Dead = static_cast<PoolIndex>(-1);
+		UTF8StringPool pool;
+		std::vector<PoolIndex> remap;//旧字符索引 -> 新字符索引，已删除的字符串为Dead
+		std::vector<uint64_t> erased;//新的墓碑位图
+		size_t ErasedChars = 0;
+		bool alive(PoolIndex id)const noexcept {
+			return remap[id] != Dead;
+		}
+		size_t orphan(const std::string_view& bytes) {//切片借用的字符串已被删除时，把切片的内容单独放进新池，并打上墓碑
+			const size_t pos = pool.put(bytes);
+			const size_t words = (pool.CharCount() + 63) / 64;
+			if (erased.size() < words) {
+				erased.resize(words);
+			}
+			erased[pos / 64] |= static_cast<uint64_t>(1) << (pos % 64);
+			ErasedChars += pool.getLastStrSize() + 1;
+			return pos;
+		}
+	};
+
+	void TreeSearcher::Compact() {
+		ticket->renew();
+		CompactState st;
+		//先按现存的条目建新池，记录每个字符的新位置
+		size_t bytes = 0;
+		size_t chars = 0;
+		for (size_t id = 0; id < strs.CharCount();) {
+			const size_t end = StrEnd(id);
+			if (!IsErased(id)) {
+				bytes += strs.getrange_view(id, end).size() + 1;
+				chars += end - id + 1;
+			}
+			id = end + 1;
+		}
+		st.pool.reserve(bytes, chars);
+		st.remap.assign(strs.CharCount(), CompactState::Dead);
+		for (size_t id = 0; id < strs.CharCount();) {
+			const size_t end = StrEnd(id);
+			if (!IsErased(id)) {
+				const size_t pos = st.pool.put(strs.getrange_view(id, end));
+				for (size_t i = id; i <= end; i++) {
+					st.remap[i] = static_cast<PoolIndex>(pos + i - id);
+				}
+			}
+			id = end + 1;
+		}
+		if (frozen != nullptr) {
+			CompactFrozen(st);
+		}
+		else {
+			size_t entries = 0;
+			root = CompactNode(root, st, entries);
+			//压缩过程中NAcc可能被降级，也可能随着整棵子树合并成密集节点被回收，所以最后从根重新收集还能到达的
+			naccs.clear();
+			CollectAccs(root);
+		}
+		strs = std::move(st.pool);
+		erased = std::move(st.erased);
+		ErasedChars = st.ErasedChars;
+		if (frozen != nullptr) {
+			strs.ShrinkToFit();
+		}
+		version++;//id全部重新编号了
+		acc.reset();
+	}
+
+	void TreeSearcher::RemapSlice(CompactState& st, PoolIndex& start, PoolIndex& end)const {
+		const PoolIndex length = end - start;
+		if (st.alive(start)) {//切片在同一个字符串内，整段平移
+			start = st.remap[start];
+		}
+		else {
+			start = static_cast<PoolIndex>(st.orphan(strs.getrange_view(start, end)));
+		}
+		end = start + length;
+	}
+
+	TreeSearcher::NodeHandle TreeSearcher::CompactNode(NodeHandle n, CompactState& st, size_t& entries) {
+		const uint32_t i = GetNodeIndex(n);
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE: {
+			std::vector<PoolIndex>& data = NDensePool[i].data;
+			size_t out = 0;
+			for (size_t j = 0; j < data.size(); j += 2) {
+				if (st.alive(data[j + 1])) {
+					data[out] = st.remap[data[j]];
+					data[out + 1] = st.remap[data[j + 1]];
+					out += 2;
+				}
+			}
+			data.resize(out);
+			entries = out / 2;
+			return n;//本来就是最小的形式
+		}
+		case NodeType::SLICE: {
+			NSlice& node = NSlicePool[i];
+			RemapSlice(st, node.start, node.end);
+			node.exit_node = CompactNode(node.exit_node, st, entries);
+			break;
+		}
+		case NodeType::MAP:
+			entries = CompactMap(NMapPool[i], st);
+			break;
+		case NodeType::ACC: {
+			NAcc& node = NAccPool[i];
+			entries = CompactMap(node.NodeMap, st);
+			if (node.NodeMap.children->size() <= static_cast<size_t>(NMapThreshold) / 2) {//留一半余量，避免反复升降级
+				NodeHandle result = NewMap();
+				NMap& m = NMapPool[GetNodeIndex(result)];
+				m.children = std::move(node.NodeMap.children);
+				m.leaves = std::move(node.NodeMap.leaves);
+				NAccPool.FreeToPool(i);
+				n = result;
+			}
+			break;
+		}
+		}
+		if (entries * 2 <= static_cast<size_t>(NDenseThreshold) / 2) {//条目很少的子树合并回密集节点，同样留一半余量
+			std::vector<PoolIndex> data;
+			data.reserve(entries * 2);
+			FlattenNode(n, 0, st.pool, data);
+			FreeTree(n);
+			NodeHandle result = NewDense();
+			NDensePool[GetNodeIndex(result)].data = std::move(data);
+			return result;
+		}
+		return n;
+	}
+
+	template<bool CanUpgrade>
+	size_t TreeSearcher::CompactMap(NMapTemplate<CanUpgrade>& m, CompactState& st) {
+		std::unordered_set<PoolIndex> leaves;
+		m.leaves.AddToSTLSet(leaves);
+		m.leaves = ObjSet<PoolIndex>();//重建一次，删空了的HashSet也退回ArraySet
+		size_t entries = 0;
+		for (const PoolIndex id : leaves) {
+			if (st.alive(id)) {
+				m.leaves.insert(st.remap[id]);
+				entries++;
+			}
+		}
+		if (m.children == nullptr) {
+			return entries;
+		}
+		for (auto it = m.children->begin(); it != m.children->end();) {
+			size_t sub = 0;
+			it->second = CompactNode(it->second, st, sub);
+			if (sub == 0) {//删空的子树直接移除
+				FreeTree(it->second);
+				it = m.children->erase(it);
+			}
+			else {
+				entries += sub;
+				++it;
+			}
+		}
+		return entries;
+	}
+
+	void TreeSearcher::FlattenNode(NodeHandle n, size_t depth, const UTF8StringPool& pool, std::vector<PoolIndex>& data)const {
+		//子树里深度为depth的位置，对应到子树根上就是往前退depth个字符
+		auto AddMap = [this, depth, &pool, &data](const auto& m) {
+			std::unordered_set<PoolIndex> leaves;
+			m.leaves.AddToSTLSet(leaves);
+			for (const PoolIndex id : leaves) {//叶子是后缀走完的位置，也就是字符串的结尾符
+				size_t end = id;
+				while (!pool.end(end)) {
+					end++;
+				}
+				data.push_back(static_cast<PoolIndex>(end - depth));
+				data.push_back(id);
+			}
+			if (m.children != nullptr) {
+				for (const auto& [c, child] : *m.children) {
+					FlattenNode(child, depth + 1, pool, data);
+				}
+			}
+		};
+		const uint32_t i = GetNodeIndex(n);
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE: {
+			const std::vector<PoolIndex>& src = NDensePool[i].data;
+			for (size_t j = 0; j < src.size(); j += 2) {
+				data.push_back(static_cast<PoolIndex>(src[j] - depth));
+				data.push_back(src[j + 1]);
+			}
+			break;
+		}
+		case NodeType::SLICE: {
+			const NSlice& node = NSlicePool[i];
+			FlattenNode(node.exit_node, depth + (node.end - node.start), pool, data);
+			break;
+		}
+		case NodeType::MAP:
+			AddMap(NMapPool[i]);
+			break;
+		case NodeType::ACC:
+			AddMap(NAccPool[i].NodeMap);
+			break;
+		}
+	}
+
+	void TreeSearcher::CollectAccs(NodeHandle n) {
+		const uint32_t i = GetNodeIndex(n);
+		auto CollectMap = [this](const auto& m) {
+			if (m.children != nullptr) {
+				for (const auto& [c, child] : *m.children) {
+					CollectAccs(child);
+				}
+			}
+		};
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE:
+			break;
+		case NodeType::SLICE:
+			CollectAccs(NSlicePool[i].exit_node);
+			break;
+		case NodeType::MAP:
+			CollectMap(NMapPool[i]);
+			break;
+		case NodeType::ACC:
+			NAccPool[i].reload(*this);//子节点变了，音素索引要重建
+			naccs.push_back(i);
+			CollectMap(NAccPool[i].NodeMap);
+			break;
+		}
+	}
+
+	void TreeSearcher::FreeTree(NodeHandle n) {
+		const uint32_t i = GetNodeIndex(n);
+		switch (GetNodeType(n)) {
+		case NodeType::DENSE:
+			break;
+		case NodeType::SLICE:
+			FreeTree(NSlicePool[i].exit_node);
+			break;
+		case NodeType::MAP:
+			if (NMapPool[i].children != nullptr) {
+				for (const auto& [c, child] : *NMapPool[i].children) {
+					FreeTree(child);
+				}
+			}
+			break;
+		case NodeType::ACC:
+			for (const auto& [c, child] : *NAccPool[i].NodeMap.children) {
+				FreeTree(child);
+			}
+			NAccPool.FreeToPool(i);//FreeNode不回收NAcc，这里单独处理
+			return;
+		}
+		FreeNode(n);
+	}
+
+	void TreeSearcher::CompactFrozen(CompactState& st) {
+		FrozenTree& t = *frozen;
+		//密集节点的键和自身的id一一对应，先按id决定键的去留
+		std::vector<bool> KeepKey(t.DenseKeys.size(), true);
+		for (const FrozenTree::Node& n : t.nodes) {
+			if (n.type == NodeType::DENSE) {
+				for (PoolIndex k = n.start; k < n.end; k++) {
+					KeepKey[k] = st.alive(t.Ids[n.IdsBegin + (k - n.start)]);
+				}
+			}
+		}
+		//任意区间的新边界就是它之前保留下来的元素个数
+		auto filter = [&st](std::vector<PoolIndex>& v, const auto& keep) {
+			std::vector<PoolIndex> pos(v.size() + 1);
+			size_t out = 0;
+			for (size_t k = 0; k < v.size(); k++) {
+				pos[k] = static_cast<PoolIndex>(out);
+				if (keep(k)) {
+					v[out++] = st.remap[v[k]];
+				}
+			}
+			pos[v.size()] = static_cast<PoolIndex>(out);
+			v.resize(out);
+			v.shrink_to_fit();
+			return pos;
+		};
+		const std::vector<PoolIndex> KeyPos = filter(t.DenseKeys, [&KeepKey](size_t k) {
+			return KeepKey[k];
+		});
+		const std::vector<PoolIndex> IdPos = filter(t.Ids, [&t, &st](size_t k) {
+			return st.alive(t.Ids[k]);
+		});
+		for (FrozenTree::Node& n : t.nodes) {
+			if (n.type == NodeType::DENSE) {
+				n.start = KeyPos[n.start];
+				n.end = KeyPos[n.end];
+			}
+			else if (n.type == NodeType::SLICE) {
+				RemapSlice(st, n.start, n.end);
+			}
+			n.IdsBegin = IdPos[n.IdsBegin];
+			n.OwnEnd = IdPos[n.OwnEnd];
+			n.IdsEnd = IdPos[n.IdsEnd];
+		}
+	}
+
+	/*
+	持久化索引格式，所有整数均为本机字节序，通过endian字段拒绝字节序不一致的文件
+	[IndexHeader][各个段，每段起始都对齐到8字节]
+	段依次为：字符串池的字节、字符串池的字节长度位(见UTF8StringPool)、FrozenTree的nodes、DenseKeys、Ids、ChildChars、ChildNodes、NAcc节点的下标、墓碑位图
+	NAcc的音素索引依赖PinIn的配置，加载时重建，不写入文件
+	*/
+	static constexpr char IndexMagic[8] = { 'P', 'I', 'N', 'I', 'N', 'T', 'R', 'E' };
+	static constexpr uint32_t IndexVersion = 3;//2：增加墓碑位图；3：字符串池的字符偏移表换成稀疏的字节长度位
+	static constexpr uint32_t IndexEndian = 0x01020304;
+
+	enum IndexSectionId : size_t {
+		StrsSection, CharBitsSection, NodesSection, DenseKeysSection, IdsSection, ChildCharsSection, ChildNodesSection, AccsSection, ErasedSection, IndexSectionNum
+	};
+
+	struct IndexHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t endian;
+		uint32_t logic;
+		uint32_t IndexWidth;//sizeof(PoolIndex)，PININCPP_COMPACT_INDEX不一致的文件不能通用
+		uint64_t fingerprint;//PinIn::DictionaryFingerprint
+		uint64_t CharCount;//字符串池的字符数，包括结尾符，字节长度位的最后一块不满时靠它区分
+		struct {
+			uint64_t offset;
+			uint64_t size;//元素数量，不是字节数
+		} sections[IndexSectionNum];
+	};
+
+	static size_t IndexAlignTo8(size_t i) noexcept {
+		return (i + 7) & ~static_cast<size_t>(7);
+	}
+
+	template<typename T>
+	static void ReadSection(const MappedFile& file, const IndexHeader& header, IndexSectionId id, std::vector<T>& out) {
+		const uint64_t offset = header.sections[id].offset;
+		const uint64_t size = header.sections[id].size;
+		if (offset % 8 != 0 || offset > file.size() || size > (file.size() - offset) / sizeof(T)) {
+			throw TreeIndexInvalid();
+		}
+		out.resize(static_cast<size_t>(size));//精确大小
+		if (size != 0) {
+			memcpy(out.data(), file.data() + offset, static_cast<size_t>(size) * sizeof(T));
+		}
+	}
+
+	void TreeSearcher::SaveIndex(const std::string_view& path)const {
+		std::unique_ptr<FrozenTree> temp;
+		const FrozenTree* tree = frozen.get();
+		if (tree == nullptr) {
+			temp = std::make_unique<FrozenTree>(*this, root);
+			tree = temp.get();
+		}
+		std::vector<uint32_t> AccNodes;
+		AccNodes.reserve(tree->accs.size());
+		for (const FrozenTree::AccIndex& a : tree->accs) {
+			AccNodes.push_back(a.node);
+		}
+
+		struct Section {
+			const void* ptr;
+			size_t size;
+			size_t ElemSize;
+		};
+		const Section sections[IndexSectionNum] = {
+			{ strs.data(), strs.size(), sizeof(char) },
+			{ strs.LengthBits(), strs.LengthBitsSize(), sizeof(uint64_t) },
+			{ tree->nodes.data(), tree->nodes.size(), sizeof(FrozenTree::Node) },
+			{ tree->DenseKeys.data(), tree->DenseKeys.size(), sizeof(PoolIndex) },
+			{ tree->Ids.data(), tree->Ids.size(), sizeof(PoolIndex) },
+			{ tree->ChildChars.data(), tree->ChildChars.size(), sizeof(uint32_t) },
+			{ tree->ChildNodes.data(), tree->ChildNodes.size(), sizeof(uint32_t) },
+			{ AccNodes.data(), AccNodes.size(), sizeof(uint32_t) },
+			{ erased.data(), erased.size(), sizeof(uint64_t) },
+		};
+		IndexHeader header{};
+		memcpy(header.magic, IndexMagic, sizeof(IndexMagic));
+		header.version = IndexVersion;
+		header.endian = IndexEndian;
+		header.logic = static_cast<uint32_t>(logic);
+		header.IndexWidth = sizeof(PoolIndex);
+		header.fingerprint = context->DictionaryFingerprint();
+		header.CharCount = strs.CharCount();
+		size_t cursor = IndexAlignTo8(sizeof(IndexHeader));
+		for (size_t i = 0; i < IndexSectionNum; i++) {
+			header.sections[i].offset = cursor;
+			header.sections[i].size = sections[i].size;
+			cursor = IndexAlignTo8(cursor + sections[i].size * sections[i].ElemSize);
+		}
+
+		std::fstream fs = std::fstream(std::string(path), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!fs.is_open()) {
+			throw PinyinFileNotOpen();
+		}
+		const char padding[8] = {};
+		size_t written = sizeof(IndexHeader);
+		fs.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+		for (size_t i = 0; i < IndexSectionNum; i++) {
+			fs.write(padding, header.sections[i].offset - written);
+			fs.write(static_cast<const char*>(sections[i].ptr), sections[i].size * sections[i].ElemSize);
+			written = header.sections[i].offset + sections[i].size * sections[i].ElemSize;
+		}
+		if (!fs.good()) {
+			throw PinyinFileNotOpen();
+		}
+	}
+
+	void TreeSearcher::LoadIndex(const std::string_view& path) {
+		MappedFile file(path);
+		if (!file.IsOpen()) {
+			throw PinyinFileNotOpen();
+		}
+		if (file.size() < sizeof(IndexHeader)) {
+			throw TreeIndexInvalid();
+		}
+		IndexHeader header;
+		memcpy(&header, file.data(), sizeof(IndexHeader));
+		if (memcmp(header.magic, IndexMagic, sizeof(IndexMagic)) != 0 || header.version != IndexVersion
+			|| header.endian != IndexEndian || header.IndexWidth != sizeof(PoolIndex)
+			|| header.logic != static_cast<uint32_t>(logic) || header.fingerprint != context->DictionaryFingerprint()) {
+			throw TreeIndexInvalid();
+		}
+		//先全部读到临时对象里并校验，失败时这棵树保持原样
+		std::vector<char> StrsData;
+		std::vector<uint64_t> CharBits;
+		std::vector<uint32_t> AccNodes;
+		std::vector<uint64_t> ErasedBits;
+		std::unique_ptr<FrozenTree> tree(new FrozenTree());
+		ReadSection(file, header, StrsSection, StrsData);
+		ReadSection(file, header, CharBitsSection, CharBits);
+		ReadSection(file, header, NodesSection, tree->nodes);
+		ReadSection(file, header, DenseKeysSection, tree->DenseKeys);
+		ReadSection(file, header, IdsSection, tree->Ids);
+		ReadSection(file, header, ChildCharsSection, tree->ChildChars);
+		ReadSection(file, header, ChildNodesSection, tree->ChildNodes);
+		ReadSection(file, header, AccsSection, AccNodes);
+		ReadSection(file, header, ErasedSection, ErasedBits);
+		tree->accs.reserve(AccNodes.size());
+		for (const uint32_t n : AccNodes) {
+			tree->accs.push_back(FrozenTree::AccIndex{ n, {} });
+		}
+		UTF8StringPool pool;
+		try {
+			if (header.CharCount > StrsData.size()) {//每个字符至少一个字节
+				throw TreeIndexInvalid();
+			}
+			pool.assign(StrsData.data(), StrsData.size(), CharBits.data(), CharBits.size(), static_cast<size_t>(header.CharCount));
+		}
+		catch (const std::invalid_argument&) {
+			throw TreeIndexInvalid();
+		}
+		tree->validate(pool.CharCount());
+		if (ErasedBits.size() > (pool.CharCount() + 63) / 64) {
+			throw TreeIndexInvalid();
+		}
+
+		ticket->renew();//先处理掉旧树上未完成的配置变更
+		NDensePool.clear();
+		NSlicePool.clear();
+		NMapPool.clear();
+		NAccPool.clear();
+		naccs.clear();
+		naccs.shrink_to_fit();
+		strs = std::move(pool);
+		erased = std::move(ErasedBits);
+		ErasedChars = 0;
+		for (size_t id = 0; id < strs.CharCount();) {
+			const size_t end = StrEnd(id);
+			if (IsErased(id)) {
+				ErasedChars += end - id + 1;
+			}
+			id = end + 1;
+		}
+		frozen = std::move(tree);
+		frozen->reload(*this);
+		version++;
+		acc.reset();
+	}
+
+	void TreeSearcher::FrozenTree::validate(size_t CharCount)const {
+		if (nodes.empty() || ChildChars.size() != ChildNodes.size() || nodes.size() > UINT32_MAX) {
+			throw TreeIndexInvalid();
+		}
+		for (const PoolIndex i : DenseKeys) {
+			if (i >= CharCount) {
+				throw TreeIndexInvalid();
+			}
+		}
+		for (const PoolIndex i : Ids) {
+			if (i >= CharCount) {
+				throw TreeIndexInvalid();
+			}
+		}
+		for (const AccIndex& a : accs) {
+			if (a.node >= nodes.size() || nodes[a.node].type != NodeType::ACC) {
+				throw TreeIndexInvalid();
+			}
+		}
+		for (size_t i = 0; i < nodes.size(); i++) {
+			const Node& n = nodes[i];
+			if (n.IdsBegin > n.OwnEnd || n.OwnEnd > n.IdsEnd || n.IdsEnd > Ids.size()) {
+				throw TreeIndexInvalid();
+			}
+			//先序排列下子节点的下标一定比父节点大，顺带保证了不会有环
+			auto ValidChild = [this, i](uint32_t child) {
+				return child > i && child < nodes.size();
+			};
+			switch (n.type) {
+			case NodeType::DENSE:
+				if (n.start > n.end || n.end > DenseKeys.size() || n.OwnEnd - n.IdsBegin != n.end - n.start) {
+					throw TreeIndexInvalid();
+				}
+				break;
+			case NodeType::SLICE:
+				if (n.start > n.end || n.end > CharCount || !ValidChild(n.ChildBegin)) {
+					throw TreeIndexInvalid();
+				}
+				break;
+			case NodeType::MAP:
+			case NodeType::ACC:
+				if (n.ChildBegin > n.ChildEnd || n.ChildEnd > ChildChars.size()) {
+					throw TreeIndexInvalid();
+				}
+				for (uint32_t k = n.ChildBegin; k < n.ChildEnd; k++) {
+					if (!ValidChild(ChildNodes[k]) || (k > n.ChildBegin && ChildChars[k - 1] >= ChildChars[k])) {
+						throw TreeIndexInvalid();
+					}
+				}
+				if (n.type == NodeType::ACC && (n.acc >= accs.size() || accs[n.acc].node != i)) {
+					throw TreeIndexInvalid();
+				}
+				break;
+			default:
+				throw TreeIndexInvalid();
 			}
 		}
 	}
@@ -6,32 +6,45 @@
 #include <memory>
 #include <unordered_map>
 #include <array>
+#include <stdexcept>
+#include <functional>
+#include <cstdint>
+#include <span>
 
 #include "PinIn.h"
 #include "StringPool.h"
 #include "Accelerator.h"
 #include "Keyboard.h"
 #include "ObjectPool.h"
+#include "WorkStealingPool.h"
+#include "SearchStats.h"
 
 namespace PinInCpp {
 	enum class Logic : uint8_t {//不需要很多状态的枚举类
 		BEGIN, CONTAIN, EQUAL
 	};
 
+	class TreeIndexInvalid : public std::exception {//持久化索引的魔数/版本/字节序/指纹/结构校验不通过
+	public:
+		virtual const char* what()const noexcept {
+			return "TreeSearcher index file is invalid, stale or has an unsupported version";
+		}
+	};
+
 	class TreeSearcher {
 	public:
 		TreeSearcher(Logic logic, const std::string_view& PinyinDictionaryPath)
-			:logic{ logic }, context(std::make_shared<PinIn>(PinyinDictionaryPath)), acc(*context) {
+			:context(std::make_shared<PinIn>(PinyinDictionaryPath)), acc(*context), logic{ logic } {
 			init();
 		}
 
 		TreeSearcher(Logic logic, const std::vector<char>& PinyinDictionaryData)
-			:logic{ logic }, context(std::make_shared<PinIn>(PinyinDictionaryData)), acc(*context) {
+			:context(std::make_shared<PinIn>(PinyinDictionaryData)), acc(*context), logic{ logic } {
 			init();
 		}
 
 		TreeSearcher(Logic logic, std::shared_ptr<PinIn> PinInShared)//如果你想共享一个PinIn对象，那么应该传递这个智能指针
-			:logic{ logic }, context(PinInShared), acc(*context) {
+			:context(PinInShared), acc(*context), logic{ logic } {
 			init();
 		}
 		virtual ~TreeSearcher() = default;
@@ -42,16 +55,290 @@ namespace PinInCpp {
 		TreeSearcher& operator=(TreeSearcher&& src) = delete;
 
 		void put(const std::string_view& keyword);//插入待搜索项，内部无查重，大小写敏感
+		/*
+		批量插入，结果等价于按顺序逐个put，适合一次性建立大索引
+		先按总长度一次性扩容字符串池，根节点升级为NMap/NAcc之后，剩下的后缀按首字符分组
+		根节点下还没有的首字符分组在线程池里各自建成独立的子树，最后挂到根节点下，已有的分组由调用线程同时插入
+		和put一样不能与搜索并发，中途抛出异常时树处于插入了一部分的状态
+		*/
+		void PutBatch(std::span<const std::string_view> keywords, WorkStealingPool& pool);
+		void PutBatch(std::span<const std::string_view> keywords) {//临时创建一个线程池
+			WorkStealingPool pool;
+			PutBatch(keywords, pool);
+		}
 		//不要传入空字符串执行搜索，这是最坏情况，最浪费性能！
 		std::vector<std::string> ExecuteSearch(const std::string_view& s);//执行搜索
 		std::vector<std::string_view> ExecuteSearchView(const std::string_view& s);//执行搜索，但是返回的字符串为只读视图，注意，这些视图可能会在插入新数据后变成悬垂视图！
-		std::unordered_set<size_t> ExecuteSearchGetSet(const std::string_view& s);//执行搜索，但是返回的是内部的结果集id
+		std::unordered_set<PoolIndex> ExecuteSearchGetSet(const std::string_view& s);//执行搜索，但是返回的是内部的结果集id，PoolIndex的宽度见StringPool.h
+
+		//打分函数，分数越高排名越靠前，同分时先插入的排前面。id是结果集id，str是对应的字符串
+		using Scorer = std::function<int64_t(PoolIndex id, std::string_view str)>;
+		//默认打分：原文直接包含搜索串的排在只有拼音匹配的前面，其次出现位置越靠前越好，最后字符串越短越好
+		//原文以搜索串开头的是第一档，ExecuteSearchTopK用默认打分时，前k名都进入第一档就提前结束
+		static int64_t DefaultScore(const std::string_view& s, std::string_view str)noexcept;
+		//只返回排名前k的结果，按排名从高到低排列，不会构建完整的结果集
+		//MaxScore是scorer可能给出的最高分，前k个结果都达到它以后剩下的结果不可能更靠前，搜索会提前结束，不知道上界时保持默认即可
+		//提前结束时还没遍历到的同样是最高分的结果不会再比较，这些并列的结果按遍历顺序取舍，不保证是先插入的那几个
+		//只有上界经常能取到时提前结束才有用，比如只分少数几档的打分
+		//scorer为空时使用DefaultScore，忽略MaxScore，以第一档的最低分作为上界：提前结束时第一档内部只按长度排序已经遍历到的那些，没有遍历到的更短的条目不再比较
+		std::vector<std::string> ExecuteSearchTopK(const std::string_view& s, size_t k, const Scorer& scorer = nullptr, int64_t MaxScore = INT64_MAX);
+		//流式结果回调，每个结果只交给回调一次，回调返回false时搜索尽快结束。id同ExecuteSearchGetSet，str是字符串池里的只读视图
+		using Callback = std::function<bool(PoolIndex id, std::string_view str)>;
+		//执行搜索，结果逐个交给回调，不构建结果集也不复制字符串，去重用的位图在多次搜索间复用。回调里不要修改这棵树
+		void ExecuteSearchStream(const std::string_view& s, const Callback& callback);
+		//上一次非const搜索的统计，只读接口的统计记在各自的上下文里。没有定义PININCPP_STATS时始终是全0
+		const SearchStats& LastStats()const noexcept {
+			return stats;
+		}
+		//每次搜索(包括用上下文的只读接口)结束后把统计交给collector汇总，可以被多棵树共享，传空指针取消。不能与搜索并发调用
+		void SetStatsCollector(std::shared_ptr<SearchStatsCollector> collector) {
+			this->collector = std::move(collector);
+		}
+
+	private:
+		//逐键搜索会话保存的边界状态，详见SearchSession
+		struct FrontierEntry {
+			enum Kind : uint8_t {
+				DENSE,//在查询结尾之前到达的密集节点，逐项检查依赖整个查询，每次都要重做
+				MOVE,//从offset经由字符ch恰好转移到查询结尾的子节点node
+				ACC_EXACT,//同上，但是是NAcc按原字符精确查找的那条边，只有长度1的转移
+				ACC_INDEX,//同上，但是是NAcc经过音素索引筛选的边，继续时要重新筛选
+				SLICE_STEP//切片node内从offset经由字符ch恰好走到查询结尾，下一个位置是pos
+			};
+			Kind kind;
+			uint32_t node;//未冻结时是NodeHandle，冻结后是FrozenTree的节点下标
+			uint32_t ch;
+			PoolIndex pos;
+			size_t offset;
+			bool operator<(const FrontierEntry& o)const noexcept {
+				if (kind != o.kind) return kind < o.kind;
+				if (node != o.node) return node < o.node;
+				if (ch != o.ch) return ch < o.ch;
+				if (pos != o.pos) return pos < o.pos;
+				return offset < o.offset;
+			}
+			bool operator==(const FrontierEntry& o)const noexcept {
+				return kind == o.kind && node == o.node && ch == o.ch && pos == o.pos && offset == o.offset;
+			}
+		};
+		class SeenIds {//可复用的去重位图，按结果集id(字符串池的字符偏移)编号，清空时只清理实际用过的字
+		public:
+			void prepare(const TreeSearcher& p) {//位图只增不减，树变大后再扩容
+				const size_t words = (p.strs.CharCount() + 63) / 64;
+				if (bits.size() < words) {
+					bits.resize(words);
+				}
+				erased = &p.erased;
+			}
+			bool insert(PoolIndex id) {//第一次出现并且没有被删除时返回真
+				const size_t w = id / 64;
+				uint64_t& word = bits[w];
+				const uint64_t bit = static_cast<uint64_t>(1) << (id % 64);
+				if (word & bit) {
+					return false;
+				}
+				if (w < erased->size() && ((*erased)[w] & bit)) {//已删除的条目，不记入位图
+					return false;
+				}
+				if (word == 0) {
+					dirty.push_back(id / 64);
+				}
+				word |= bit;
+				return true;
+			}
+			void clear()noexcept {
+				for (const size_t w : dirty) {
+					bits[w] = 0;
+				}
+				dirty.clear();
+			}
+			size_t MemoryUsage()const noexcept {
+				return HeapBytes(bits) + HeapBytes(dirty);
+			}
+		private:
+			std::vector<uint64_t> bits;
+			std::vector<size_t> dirty;
+			const std::vector<uint64_t>* erased = nullptr;//所属树的墓碑位图
+		};
+	public:
+		class ResultSink {//结果的接收方，树在遍历过程中把命中的id逐个交给它，同一个id可能出现多次
+		public:
+			virtual ~ResultSink() = default;
+			virtual void insert(PoolIndex id) = 0;
+			virtual void insert(const PoolIndex* first, const PoolIndex* last) {//连续的一段id
+				for (; first != last; first++) {
+					insert(*first);
+				}
+			}
+			bool stopped()const noexcept {//为真时遍历会尽快结束，已经交出去的结果依然有效
+				return stop;
+			}
+		protected:
+			bool stop = false;
+		private:
+			friend TreeSearcher;
+			std::vector<FrontierEntry>* frontier = nullptr;//不为空时遍历会顺带记录逐键搜索的边界
+			std::vector<std::pair<uint32_t, size_t>>* forks = nullptr;//不为空时ForkRoot以外的节点不再递归，只记录(节点, offset)留给并行搜索分发
+			uint32_t ForkRoot = 0;
+		};
+
+		class SearchContext {//查询上下文，持有搜索过程中的可变状态，每个线程各自持有一个，就可以并发地搜索同一棵树
+		public:
+			SearchContext(const TreeSearcher& tree) :tree{ tree }, acc(*tree.context) {
+				acc.setProvider(&tree.strs);
+				ticket = tree.context->ticket([this]() {
+					this->acc.reset();
+				});
+			}
+			//因为绑定着this指针，所以不能移动和拷贝
+			SearchContext(const SearchContext&) = delete;
+			SearchContext(SearchContext&&) = delete;
+			SearchContext& operator=(SearchContext&& src) = delete;
+			const SearchStats& LastStats()const noexcept {//用这个上下文的上一次搜索的统计
+				return stats;
+			}
+			size_t MemoryUsage()const noexcept {//堆内存，单位是字节，不含上下文对象本身
+				return acc.MemoryUsage() + seen.MemoryUsage() + sizeof(PinIn::Ticket);
+			}
+		private:
+			friend TreeSearcher;
+			const TreeSearcher& tree;//绑定创建它的树，不能拿去搜索其他树
+			Accelerator acc;
+			std::unique_ptr<PinIn::Ticket> ticket;
+			SeenIds seen;
+			SearchStats stats;
+		};
+		//只读的搜索接口，树本身不会被修改，多个线程各自用自己的SearchContext可以同时调用
+		//注意，只读接口不会自动刷新树，PinIn的配置被commit后，需要先调用一次refresh()(或者任意非const的搜索/put)，并且put/refresh期间不能有并发的搜索
+		std::vector<std::string> ExecuteSearch(SearchContext& ctx, const std::string_view& s)const;
+		std::vector<std::string_view> ExecuteSearchView(SearchContext& ctx, const std::string_view& s)const;
+		std::unordered_set<PoolIndex> ExecuteSearchGetSet(SearchContext& ctx, const std::string_view& s)const;
+		std::vector<std::string> ExecuteSearchTopK(SearchContext& ctx, const std::string_view& s, size_t k, const Scorer& scorer = nullptr, int64_t MaxScore = INT64_MAX)const;
+		void ExecuteSearchStream(SearchContext& ctx, const std::string_view& s, const Callback& callback)const;
+
+		/*
+		逐键搜索会话，给输入框自动补全这种"z" "zh" "zho" "zhon" "zhong"逐个发送的场景用
+		会话记住上一次查询的边界：查询结尾之前访问过的密集节点，以及恰好转移到查询结尾的那些边
+		在部分匹配(BEGIN/CONTAIN)下，新查询只是在旧查询后面追加字符时，所有新增的匹配路径都必然经过这些边界，所以只从边界继续搜索，不再从根节点开始
+		删除、修改字符，EQUAL逻辑，树被修改(put/Freeze/LoadIndex/Compact)或者PinIn配置变化时自动退回完整搜索，结果和完整搜索一致
+		和SearchContext一样，每个线程各自持有，用只读接口搜索
+		*/
+		class SearchSession {
+		public:
+			SearchSession(const TreeSearcher& tree) :tree{ tree }, acc(*tree.context) {
+				acc.setProvider(&tree.strs);
+				ticket = tree.context->ticket([this]() {
+					this->acc.reset();
+					this->valid = false;//音素索引和匹配结果都可能变了，边界作废
+				});
+			}
+			//因为绑定着this指针，所以不能移动和拷贝
+			SearchSession(const SearchSession&) = delete;
+			SearchSession(SearchSession&&) = delete;
+			SearchSession& operator=(SearchSession&& src) = delete;
+			void reset()noexcept {//丢弃边界，下次搜索从头开始
+				valid = false;
+			}
+			const SearchStats& LastStats()const noexcept {//从边界继续的搜索只统计实际访问的部分
+				return stats;
+			}
+			size_t MemoryUsage()const noexcept {//堆内存，单位是字节，不含会话对象本身
+				return acc.MemoryUsage() + seen.MemoryUsage() + sizeof(PinIn::Ticket) + HeapBytes(last) + HeapBytes(frontier);
+			}
+		private:
+			friend TreeSearcher;
+			const TreeSearcher& tree;
+			Accelerator acc;
+			std::unique_ptr<PinIn::Ticket> ticket;
+			std::string last;//上一次的查询
+			std::vector<FrontierEntry> frontier;
+			size_t version = 0;//记录边界时树的版本
+			bool valid = false;
+			SeenIds seen;
+			SearchStats stats;
+		};
+		std::vector<std::string> ExecuteSearch(SearchSession& session, const std::string_view& s)const;
+		std::vector<std::string_view> ExecuteSearchView(SearchSession& session, const std::string_view& s)const;
+		std::unordered_set<PoolIndex> ExecuteSearchGetSet(SearchSession& session, const std::string_view& s)const;
+		void ExecuteSearchStream(SearchSession& session, const std::string_view& s, const Callback& callback)const;
+
+		/*
+		单棵树内的并行搜索上下文，绑定一个工作窃取线程池
+		搜索时调用线程先展开根节点，根节点的每个子节点(以及到达它时的查询位置)作为任务分发到线程池，各个工作线程用自己的Accelerator和去重位图搜索，最后合并
+		和SearchContext一样，不同的调用线程各自持有一个，就可以并发地搜索同一棵树，也可以共享同一个线程池
+		适合数据量很大、根节点分支很多的树，小树和很具体的查询直接用SearchContext更快
+		*/
+		class ParallelContext {
+		public:
+			ParallelContext(const TreeSearcher& tree, WorkStealingPool& pool) :tree{ tree }, pool{ pool } {
+				for (size_t i = 0; i <= pool.size(); i++) {//每个工作线程一份，最后一份给调用线程
+					workers.push_back(std::make_unique<Worker>(tree));
+				}
+				ticket = tree.context->ticket([this]() {
+					for (const auto& w : this->workers) {
+						w->acc.reset();
+					}
+				});
+			}
+			//因为绑定着this指针，所以不能移动和拷贝
+			ParallelContext(const ParallelContext&) = delete;
+			ParallelContext(ParallelContext&&) = delete;
+			ParallelContext& operator=(ParallelContext&& src) = delete;
+			const SearchStats& LastStats()const noexcept {//各个工作线程的计数之和，耗时是调用线程看到的
+				return stats;
+			}
+			size_t MemoryUsage()const noexcept {//堆内存，单位是字节，不含上下文对象本身和线程池
+				size_t bytes = HeapBytes(workers) + sizeof(PinIn::Ticket);
+				for (const auto& w : workers) {
+					bytes += sizeof(Worker) + w->acc.MemoryUsage() + w->seen.MemoryUsage() + HeapBytes(w->ids);
+				}
+				return bytes;
+			}
+		private:
+			friend TreeSearcher;
+			struct Worker {
+				Worker(const TreeSearcher& tree) :acc(*tree.context) {
+					acc.setProvider(&tree.strs);
+				}
+				Accelerator acc;
+				SeenIds seen;
+				std::vector<PoolIndex> ids;
+				SearchStats stats;
+			};
+			const TreeSearcher& tree;
+			WorkStealingPool& pool;
+			std::vector<std::unique_ptr<Worker>> workers;
+			std::unique_ptr<PinIn::Ticket> ticket;
+			SearchStats stats;
+		};
+		std::vector<std::string> ExecuteSearch(ParallelContext& ctx, const std::string_view& s)const;
+		std::vector<std::string_view> ExecuteSearchView(ParallelContext& ctx, const std::string_view& s)const;
+		std::unordered_set<PoolIndex> ExecuteSearchGetSet(ParallelContext& ctx, const std::string_view& s)const;
 		std::string GetStrById(size_t id) {//配套使用。id请使用ExecuteSearchGetSet返回的合法的来源
 			return strs.getstr(id);
 		}
 		std::string_view GetStrViewById(size_t id)const {//注意，这些视图可能会在插入新数据后变成悬垂视图！
 			return strs.getstr_view(id);
 		}
+		//按插入顺序遍历所有现存的字符串，跳过已删除的，视图的有效期同GetStrViewById
+		void ForEachStr(const std::function<void(std::string_view str)>& callback)const;
+		//删除一个条目，id同ExecuteSearchGetSet，删除后不会再出现在任何搜索结果里，冻结的树也可以删除
+		//只在墓碑位图上做标记，节点和字符串池保持原样，由Compact统一清理。id不是现存的条目(包括已经删除过的)时返回false
+		//和put一样不能与搜索并发
+		bool erase(size_t id);
+		//用新的字符串替换一个条目，等价于put之后erase，返回新条目的id
+		//冻结的树不能更新，抛出std::logic_error；id不是现存的条目时抛出std::invalid_argument
+		size_t update(size_t id, const std::string_view& keyword);
+		double GarbageRatio()const noexcept {//已删除的字符串在字符串池里所占的比例(按字符数)，调用方据此决定什么时候Compact
+			return strs.CharCount() == 0 ? 0.0 : static_cast<double>(ErasedChars) / static_cast<double>(strs.CharCount());
+		}
+		/*
+		压缩：字符串池只保留现存的条目，节点里已删除的id一并清理，只是按新旧位置的对照表改写节点，不需要重新匹配和插入
+		所有id按原来的顺序重新编号，之前拿到的id和视图全部失效
+		未冻结的树顺带降级：清空的子树直接移除，剩下的条目不超过密集节点容量一半的子树合并回NDense，子节点减半的NAcc退回NMap
+		冻结的树只清理id，节点结构不变，压缩后依然是冻结的
+		*/
+		void Compact();
 		//单位是字节
 		void StrPoolReserve(size_t _Newcapacity) {
 			strs.reserve(_Newcapacity);
@@ -69,30 +356,187 @@ namespace PinInCpp {
 		std::shared_ptr<PinIn> GetPinInShared() noexcept {//返回这个对象的智能指针，让你可以共享到其他TreeSearcher
 			return context;
 		}
-		void ClearFreeList() {//手动清理对象池
-			NDensePool.ClearFreeList();
-			NSlicePool.ClearFreeList();
-			NMapPool.ClearFreeList();
+		void ClearFreeList() {//节点回收时就已经析构了，这里只释放各个竞技场空闲列表多余的容量
+			NDensePool.ShrinkFreeList();
+			NSlicePool.ShrinkFreeList();
+			NMapPool.ShrinkFreeList();
+			NAccPool.ShrinkFreeList();
 		}
 		void ShrinkToFit() {//调用的是std::vector<char>::shrink_to_fit
 			strs.ShrinkToFit();
 		}
+		struct NodeMemory {
+			size_t count = 0;//存活的节点数
+			size_t bytes = 0;//节点本身和它持有的数组/子节点表，不含ObjSet和音素索引
+		};
+		/*
+		按子系统拆分的内存占用，单位是字节，是按容器容量计算的堆内存(不含分配器自身的簿记)，无序容器的部分是估算值(见MemoryUsage.h)
+		不含TreeSearcher对象本身、共享的PinIn(见PinIn::MemoryUsage)和各个搜索上下文(见它们各自的MemoryUsage)
+		*/
+		struct MemoryReport {
+			UTF8StringPool::MemoryReport strs;
+			NodeMemory DenseNodes;
+			NodeMemory SliceNodes;
+			NodeMemory MapNodes;
+			NodeMemory AccNodes;
+			size_t ObjSets = 0;//NMap/NAcc的叶子集合，包括多态的容器对象本身
+			size_t AccIndex = 0;//NAcc的音素索引(index_node)
+			size_t FreeLists = 0;//节点竞技场里回收待复用和还没用到的槽位、空闲下标列表和块表，ClearFreeList只能释放其中的空闲下标列表
+			size_t frozen = 0;//冻结后的紧凑数组和音素索引
+			size_t accelerator = 0;//非const搜索接口自己的Accelerator，主要是记忆表
+			size_t other = 0;//去重位图、墓碑位图、NAcc下标表和配置变化的回调
+			size_t total()const noexcept {
+				return strs.total() + DenseNodes.bytes + SliceNodes.bytes + MapNodes.bytes + AccNodes.bytes
+					+ ObjSets + AccIndex + FreeLists + frozen + accelerator + other;
+			}
+		};
+		MemoryReport MemoryUsage()const;//遍历所有节点，和put一样不能与修改并发
+		//冻结这棵树：按深度优先顺序把所有节点压平到只读的紧凑数组里，并释放构建期的节点和对象池
+		//冻结后不能再put，搜索结果与冻结前一致，适合一次性批量插入后长期驻留的索引
+		void Freeze();
+		bool IsFrozen()const noexcept {
+			return frozen != nullptr;
+		}
+		//把字符串池和冻结后的节点结构写入文件，未冻结的树会临时压平一份再写，树本身不受影响
+		//文件记录了匹配逻辑和PinIn的字典指纹，NAcc的音素索引依赖拼音配置，不写入文件，加载时按当前配置重建
+		//墓碑位图一并写入，加载后已删除的条目依然不可见
+		void SaveIndex(const std::string_view& path)const;
+		//用SaveIndex的文件替换这棵树的全部内容，加载后的树是冻结的，不需要重新插入
+		//逻辑、字典指纹或者PoolIndex宽度不一致以及文件损坏时抛出TreeIndexInvalid，打不开文件时抛出PinyinFileNotOpen
+		void LoadIndex(const std::string_view& path);
 	private:
+		struct ShardTag {};
+		//PutBatch用的分片树，共享主树的PinIn和字符串池(只读)，只用自己的节点竞技场建子树，建好后由主树接管节点
+		TreeSearcher(ShardTag, const TreeSearcher& owner)
+			:context(owner.context), keys{ &owner.strs }, acc(*context), logic{ owner.logic } {
+			init();
+			acc.setProvider(keys);
+		}
 		void init() {
-			root = std::make_unique<NDense>();
+			root = NewDense();
 			acc.setProvider(&strs);
 			ticket = context->ticket([this]() {
-				for (const auto& i : this->naccs) {
-					i->reload(*this);
+				for (const uint32_t i : this->naccs) {
+					NAccPool[i].reload(*this);
+				}
+				if (this->frozen != nullptr) {
+					this->frozen->reload(*this);
 				}
 				this->acc.reset();
 			});
 		}
-		void CommonSearch(const std::string_view& s, std::unordered_set<size_t>& ret) {
+		//位图去重后按首次出现的顺序收集id，原有的ExecuteSearch系列接口用它，最后再一次性转换成输出格式
+		//CONTAIN下同一个id会被每个后缀重复交出很多次，位图判重比逐个插入std::unordered_set省去了大量哈希和节点分配
+		class IdSink : public ResultSink {
+		public:
+			//keep为真时析构不清空位图，同一个位图跨多次遍历去重，由调用方统一清理
+			IdSink(const TreeSearcher& p, SeenIds& seen, std::vector<PoolIndex>& ids, bool keep = false) :seen{ seen }, ids{ ids }, keep{ keep } {
+				seen.prepare(p);
+			}
+			~IdSink() {
+				if (!keep) {
+					seen.clear();
+				}
+			}
+			virtual void insert(PoolIndex id) {
+				PININCPP_STAT(RawResults++);
+				if (seen.insert(id)) {
+					PININCPP_STAT(UniqueResults++);
+					ids.push_back(id);
+				}
+			}
+		private:
+			SeenIds& seen;
+			std::vector<PoolIndex>& ids;
+			bool keep;
+		};
+		class TopKSink;//ExecuteSearchTopK用，定义在TreeSearcher.cpp
+		class StreamSink : public ResultSink {//位图去重后直接交给回调，析构时清空位图，回调抛出异常也能复用
+		public:
+			StreamSink(const TreeSearcher& p, SeenIds& seen, const Callback& callback) :p{ p }, seen{ seen }, callback{ callback } {
+				seen.prepare(p);
+			}
+			~StreamSink() {
+				seen.clear();
+			}
+			virtual void insert(PoolIndex id) {
+				PININCPP_STAT(RawResults++);
+				if (stop || !seen.insert(id)) {
+					return;
+				}
+				PININCPP_STAT(UniqueResults++);
+				if (!callback(id, p.strs.getstr_view(id))) {
+					stop = true;
+				}
+			}
+		private:
+			const TreeSearcher& p;
+			SeenIds& seen;
+			const Callback& callback;
+		};
+		bool IsErased(size_t id)const noexcept {
+			return id / 64 < erased.size() && (erased[id / 64] >> (id % 64) & 1);
+		}
+		bool IsEntry(size_t id)const noexcept {//是现存条目的首字符：前一个字符是结尾符，并且没有被删除
+			return id < strs.CharCount() && (id == 0 || strs.end(id - 1)) && !IsErased(id);
+		}
+		size_t StrEnd(size_t id)const noexcept {//条目结尾符的字符索引
+			while (!strs.end(id)) {
+				id++;
+			}
+			return id;
+		}
+		void CommonSearch(const std::string_view& s, std::vector<PoolIndex>& ret) {
+			IdSink sink(*this, seen, ret);
+			CommonSearch(s, sink);
+		}
+		void CommonSearch(const std::string_view& s, ResultSink& ret) {
 			ticket->renew();
+			CommonSearch(acc, s, ret);
+		}
+		void CommonSearch(SearchContext& ctx, const std::string_view& s, std::vector<PoolIndex>& ret)const {
+			IdSink sink(*this, ctx.seen, ret);
+			CommonSearch(ctx, s, sink);
+		}
+		void CommonSearch(SearchContext& ctx, const std::string_view& s, ResultSink& ret)const {
+			if (&ctx.tree != this) {
+				throw std::invalid_argument("SearchContext belongs to another TreeSearcher");
+			}
+			ctx.ticket->renew();
+			CommonSearch(ctx.acc, s, ret);
+		}
+		void CommonSearch(Accelerator& acc, const std::string_view& s, ResultSink& ret)const {
 			acc.search(s);
-			root->get(*this, ret, 0);
+			//NAcc和NSlice直接用acc.get匹配，不会切换模式，只有密集节点的begins/matches会切换
+			//所以在搜索开始前按逻辑切换好，否则部分匹配的树在经过密集节点之前会按完整匹配记忆结果，搜索结果取决于之前的搜索历史
+			acc.setPartial(logic != Logic::EQUAL);
+			PININCPP_STATS_MARK(PrepareNs);
+			if (frozen != nullptr) {
+				frozen->get(*this, acc, ret, 0, 0);
+			}
+			else {
+				get(root, acc, ret, 0);
+			}
+			PININCPP_STATS_MARK(TraverseNs);
+		}
+		void CommonSearch(SearchSession& session, const std::string_view& s, std::vector<PoolIndex>& ret)const {
+			IdSink sink(*this, session.seen, ret);
+			CommonSearch(session, s, sink);
 		}
+		void CommonSearch(SearchSession& session, const std::string_view& s, ResultSink& ret)const;
+		void CommonSearch(ParallelContext& ctx, const std::string_view& s, std::vector<PoolIndex>& ret)const;
+		void resume(const FrontierEntry& e, Accelerator& acc, ResultSink& ret, size_t OldSize)const;
+		bool AccIndexPass(uint32_t ch, const Accelerator& acc, size_t offset)const;
+		//转移恰好落在查询结尾时记录边界
+		static void RecordLanding(ResultSink& ret, const Accelerator& acc, FrontierEntry::Kind kind, uint32_t node, uint32_t ch, size_t offset, size_t next, size_t pos = 0) {
+			if (ret.frontier != nullptr && next == acc.search().size()) {
+				ret.frontier->push_back(FrontierEntry{ kind, node, ch, static_cast<PoolIndex>(pos), offset });
+			}
+		}
+		std::vector<std::string> CollectStr(const std::vector<PoolIndex>& ret)const;
+		std::vector<std::string_view> CollectStrView(const std::vector<PoolIndex>& ret)const;
+		template<typename SearchFunc>
+		std::vector<std::string> CommonTopK(SeenIds& seen, const std::string_view& s, size_t k, const Scorer& scorer, int64_t MaxScore, SearchFunc&& search)const;
 		template<typename value>
 		class ObjSet {//这是专门用于优化的类，本身功能并不多！
 		private:
@@ -100,7 +544,9 @@ namespace PinInCpp {
 			public:
 				virtual ~AbstractSet() = default;
 				virtual AbstractSet* insert(const value& input_v) = 0;
-				virtual void AddToSTLSet(std::unordered_set<value>& input_v) = 0;//有点反客为主了
+				virtual void AddToSTLSet(std::unordered_set<value>& input_v)const = 0;//有点反客为主了
+				virtual void AddToSink(ResultSink& sink)const = 0;
+				virtual size_t MemoryUsage()const noexcept = 0;//包括容器对象本身
 			};
 			class HashSet : public AbstractSet {
 			public:
@@ -108,11 +554,19 @@ namespace PinInCpp {
 					data.insert(input_v);
 					return this;
 				}
-				virtual void AddToSTLSet(std::unordered_set<value>& input_v) {
+				virtual void AddToSTLSet(std::unordered_set<value>& input_v)const {
 					for (const value& v : data) {
 						input_v.insert(v);
 					}
 				}
+				virtual void AddToSink(ResultSink& sink)const {
+					for (const value& v : data) {
+						sink.insert(v);
+					}
+				}
+				virtual size_t MemoryUsage()const noexcept {
+					return sizeof(HashSet) + HeapBytes(data);
+				}
 			private:
 				std::unordered_set<value> data;
 			};
@@ -134,11 +588,17 @@ namespace PinInCpp {
 					}
 					return this;
 				}
-				virtual void AddToSTLSet(std::unordered_set<value>& input_v) {
+				virtual void AddToSTLSet(std::unordered_set<value>& input_v)const {
 					for (const value& v : data) {
 						input_v.insert(v);
 					}
 				}
+				virtual void AddToSink(ResultSink& sink)const {
+					sink.insert(data.data(), data.data() + data.size());
+				}
+				virtual size_t MemoryUsage()const noexcept {
+					return sizeof(ArraySet) + HeapBytes(data);
+				}
 			private:
 				std::vector<value> data;
 			};
@@ -156,125 +616,142 @@ namespace PinInCpp {
 					Container.reset(set);
 				}
 			}
-			void AddToSTLSet(std::unordered_set<value>& input_v) {
+			void AddToSTLSet(std::unordered_set<value>& input_v)const {
 				Container->AddToSTLSet(input_v);
 			}
+			void AddToSink(ResultSink& sink)const {
+				Container->AddToSink(sink);
+			}
+			size_t MemoryUsage()const noexcept {//被移走后容器为空
+				return Container != nullptr ? Container->MemoryUsage() : 0;
+			}
 		};
-		class Node {//节点类本身是私有的就行了，构造函数公有但外部不需要知道存在节点类
-		public://节点类中用参数传递TreeSearcher的引用比类成员要高效，因为类成员要走this指针解析，第一个参数传引用在x64环境下一般是寄存器传递，绕过了this指针中间商，所以构建速度变更快了
-			virtual ~Node() = default;
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& result, size_t offset) = 0;
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& result) = 0;
-			//为了实现节点替换行为，我已经在API内约定好了，返回一个它本身或者一个新的Node指针，所以前后不一致的时候重设，并且new的方法不会持有这个指针
-			virtual Node* put(TreeSearcher& p, size_t keyword, size_t id) = 0;
-			//将自身载入对象池
-			virtual void FreeToPool(TreeSearcher& p) = 0;
+		//节点句柄，高2位是节点类型，低30位是节点在对应竞技场中的下标，所以每种节点最多2^30个
+		//节点不再是独立分配的多态对象，而是按类型存放在SlabPool里，遍历时按类型标签分派
+		using NodeHandle = uint32_t;
+		enum class NodeType : uint8_t {
+			DENSE, SLICE, MAP, ACC
 		};
-		//将Node*的所有权通过FreeToPool转移到对象池中，随后放弃其所有权并重设为新指针
-		void NodeOwnershipReset(std::unique_ptr<Node>& smartPtrObj, Node* newPtr) {
-			smartPtrObj->FreeToPool(*this);//记录
-			smartPtrObj.release();//不要了，已经被标记在对象池中待清除/复用了，所以这时候要release他释放其所有权
-			smartPtrObj.reset(newPtr);
+		static constexpr uint32_t NodeTypeShift = 30;
+		static constexpr uint32_t NodeIndexMask = (static_cast<uint32_t>(1) << NodeTypeShift) - 1;
+		static NodeHandle MakeHandle(NodeType type, uint32_t index) {
+			if (index > NodeIndexMask) {
+				throw std::length_error("TreeSearcher node count exceeds the capacity of NodeHandle");
+			}
+			return (static_cast<uint32_t>(type) << NodeTypeShift) | index;
+		}
+		static NodeType GetNodeType(NodeHandle n) noexcept {
+			return static_cast<NodeType>(n >> NodeTypeShift);
+		}
+		static uint32_t GetNodeIndex(NodeHandle n) noexcept {
+			return n & NodeIndexMask;
 		}
 
-		template<size_t size>
-		using SizeTList = std::array<size_t, size>;
+		//节点操作的分派函数，替代原来的虚函数
+		//搜索期间节点是只读的，可变的查询状态全部在acc里
+		void get(NodeHandle n, Accelerator& acc, ResultSink& ret, size_t offset)const;
+		void get(NodeHandle n, ResultSink& ret)const;
+		//为了实现节点替换行为，约定返回它本身或者一个新的节点句柄，前后不一致的时候由调用方重设并回收旧节点
+		NodeHandle put(NodeHandle n, size_t keyword, size_t id);
+		//对slot指向的节点执行put，节点被替换时回收旧节点并更新slot
+		void PutChild(NodeHandle& slot, size_t keyword, size_t id) {
+			NodeHandle result = put(slot, keyword, id);
+			if (result != slot) {
+				FreeNode(slot);
+				slot = result;
+			}
+		}
+		void FreeNode(NodeHandle n);//只回收这个节点本身，不会递归回收子节点
+		NodeHandle adopt(TreeSearcher& shard, NodeHandle n);//把分片树里的子树搬进自己的竞技场，返回新句柄
+		void AttachRootChild(uint32_t ch, NodeHandle child);//和NMap::put新增子节点时的行为一致，包括升级和NAcc的索引
+		NodeHandle NewDense() {
+			return MakeHandle(NodeType::DENSE, NDensePool.NewObj());
+		}
+		NodeHandle NewSlice(size_t start, size_t end, NodeHandle exit_node) {
+			return MakeHandle(NodeType::SLICE, NSlicePool.NewObj(start, end, exit_node));
+		}
+		NodeHandle NewMap() {
+			return MakeHandle(NodeType::MAP, NMapPool.NewObj());
+		}
+		template<bool CanUpgrade>
+		class NMapTemplate;
+		NodeHandle NewAcc(NMapTemplate<true>& src);
+		struct CompactState;//Compact用，定义在TreeSearcher.cpp
+		void RemapSlice(CompactState& st, PoolIndex& start, PoolIndex& end)const;
+		NodeHandle CompactNode(NodeHandle n, CompactState& st, size_t& entries);//返回压缩或者降级后的句柄，entries是子树里剩下的条目数
+		template<bool CanUpgrade>
+		size_t CompactMap(NMapTemplate<CanUpgrade>& m, CompactState& st);
+		void FlattenNode(NodeHandle n, size_t depth, const UTF8StringPool& pool, std::vector<PoolIndex>& data)const;//子树的全部条目按NDense的格式收集
+		void FreeTree(NodeHandle n);//递归回收整棵子树
+		void CollectAccs(NodeHandle n);//把子树里的NAcc加入naccs并重载它们的索引
+		void CompactFrozen(CompactState& st);
 
-		class NDense : public Node {//密集节点本质上就是数组
+		class NDense {//密集节点本质上就是数组
 		public:
-			virtual ~NDense() = default;
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& ret, size_t offset);
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& ret);
-			virtual Node* put(TreeSearcher& p, size_t keyword, size_t id);
-			virtual void FreeToPool(TreeSearcher& p) {
-				p.NDensePool.FreeToPool(this);
-			}
+			void get(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, size_t offset)const;
+			void get(const TreeSearcher& p, ResultSink& ret)const;
+			NodeHandle put(TreeSearcher& p, NodeHandle self, size_t keyword, size_t id);
 		private:
 			friend TreeSearcher;
 			size_t match(const TreeSearcher& p)const;//寻找最长公共前缀 长度
-			/*class DenseVec {
-			public:
-
-				DenseVec(const DenseVec&) = delete;
-				DenseVec(DenseVec&&) = delete;
-				DenseVec& operator=(DenseVec&& src) = delete;
-			private:
-				size_t* start = nullptr;
-				size_t* end = nullptr;//首尾相减除以大小即是capacity
-				size_t* cursor = nullptr;//当前分配到的位置
-
-			};*/
-			std::vector<size_t> data;
+			std::vector<PoolIndex> data;//字符索引和字符串id交替存储
 		};
 		class NSlice;
 		class NAcc;
 
 		template<bool CanUpgrade>//类策略模式，运行时比较开销放到编译时
-		class NMapTemplate : public Node {
+		class NMapTemplate {
 		public:
-			virtual ~NMapTemplate() = default;
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& ret, size_t offset);
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& ret) {
-				leaves.AddToSTLSet(ret);
+			void get(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, size_t offset)const;
+			void get(const TreeSearcher& p, ResultSink& ret)const {
+				leaves.AddToSink(ret);
 				if constexpr (CanUpgrade) {//可升级模式需要判断children的有效性，但是不可升级模式下本身是由children过大而引起的升级，所以不需要判断有效性
 					if (children == nullptr) {
 						return;
 					}
 				}
 				for (const auto& v : *children) {
-					v.second->get(p, ret);
-				}
-			}
-			virtual Node* put(TreeSearcher& p, size_t keyword, size_t id);
-			virtual void FreeToPool(TreeSearcher& p) {
-				if constexpr (CanUpgrade) {//NMapOwned和NAcc一样，因为不会升级所以也不会被析构，除非树本身的生命周期结束
-					p.NMapPool.FreeToPool(this);
+					p.get(v.second, ret);
 				}
 			}
+			NodeHandle put(TreeSearcher& p, NodeHandle self, size_t keyword, size_t id);
 		private:
+			friend TreeSearcher;
 			friend NSlice;
 			friend NAcc;
 			void init() {//如果是不可升级的版本，则是一个无用的init函数
 				if constexpr (CanUpgrade) {
 					if (children == nullptr) {
-						children = std::make_unique<std::unordered_map<uint32_t, std::unique_ptr<Node>>>();
+						children = std::make_unique<std::unordered_map<uint32_t, NodeHandle>>();
 					}
 				}
 			}
-			Node* put(const uint32_t ch, std::unique_ptr<Node> n) {
+			void put(const uint32_t ch, NodeHandle n) {
 				if constexpr (CanUpgrade) {//可升级模式需要懒加载代码，不可升级模式会有构造方移动原始数据，始终安全
 					init();
 				}
-				//它本质上是什么？所有权转移，那么前后指针，实际上是不变的
-				Node* result = n.get();
-				children->insert_or_assign(ch, std::move(n));
-				return result;
+				children->insert_or_assign(ch, n);
 			}
-			void reset_children(TreeSearcher& p, const uint32_t ch, Node* n) {
-				p.NodeOwnershipReset(children->operator[](ch), n);
-			}
-			std::unique_ptr<std::unordered_map<uint32_t, std::unique_ptr<Node>>> children = nullptr;
-			ObjSet<size_t> leaves;//经常出现占用较少情况，适合做升级优化
+			std::unique_ptr<std::unordered_map<uint32_t, NodeHandle>> children = nullptr;
+			ObjSet<PoolIndex> leaves;//经常出现占用较少情况，适合做升级优化
 		};
 		using NMap = NMapTemplate<true>;//会自动升级的版本
 		using NMapOwned = NMapTemplate<false>;//不会自动升级的版本，给NAcc类用的，升级过程中自动窃取了其成员，所以用了模板元编程技术去掉懒加载模式
 
-		class NAcc : public Node {//组合而非继承，不会升级的节点
+		class NAcc {//组合而非继承，不会升级的节点
 		public:
-			virtual ~NAcc() = default;
 			NAcc(TreeSearcher& p, NMap& src) {
 				GetOwned(src);//获取所有权，本质上相当于原始代码里的那个引用拷贝
 				reload(p);
-				p.naccs.push_back(this);
 			}
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& result, size_t offset);
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& result) {
+			void get(const TreeSearcher& p, Accelerator& acc, ResultSink& result, size_t offset)const;
+			void get(const TreeSearcher& p, ResultSink& result)const {
 				NodeMap.get(p, result);//直接调用原始的版本，因为原版Java代码写的是继承，所以没有显式实现
 			}
-			virtual Node* put(TreeSearcher& p, size_t keyword, size_t id) {
-				NodeMap.put(p, keyword, id);//绝对不会升级，不需要检查
-				index(p, p.strs.getcharFourCC(keyword));//put完后构建索引，并且不再有put操作，应该是安全的
-				return this;
+			NodeHandle put(TreeSearcher& p, NodeHandle self, size_t keyword, size_t id) {
+				NodeMap.put(p, self, keyword, id);//绝对不会升级，不需要检查
+				index(p, p.keys->getcharFourCC(keyword));//put完后构建索引，并且不再有put操作，应该是安全的
+				return self;
 			}
 			void reload(TreeSearcher& p) {
 				index_node.clear();//释放所有音素
@@ -282,9 +759,8 @@ namespace PinInCpp {
 					index(p, k);
 				}
 			}
-			//你不需要，只需要一个空函数即可
-			virtual void FreeToPool(TreeSearcher& p) {}
 		private:
+			friend TreeSearcher;
 			void GetOwned(NMap& src) {
 				NodeMap.children = std::move(src.children);
 				NodeMap.leaves = std::move(src.leaves);
@@ -295,28 +771,71 @@ namespace PinInCpp {
 			NMapOwned NodeMap;
 		};
 
-		class NSlice : public Node {
+		class NSlice {
 		public:
-			virtual ~NSlice() = default;
-			NSlice(TreeSearcher& p, size_t start, size_t end) :start{ start }, end{ end } {
-				exit_node = p.NMapPool.NewObj();
-			}
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& ret, size_t offset) {
-				get(p, ret, offset, 0);
+			NSlice(size_t start, size_t end, NodeHandle exit_node)
+				:exit_node{ exit_node }, start{ static_cast<PoolIndex>(start) }, end{ static_cast<PoolIndex>(end) } {
 			}
-			virtual void get(TreeSearcher& p, std::unordered_set<size_t>& ret) {
-				exit_node->get(p, ret);
-			}
-			virtual Node* put(TreeSearcher& p, size_t keyword, size_t id);
-			virtual void FreeToPool(TreeSearcher& p) {
-				p.NSlicePool.FreeToPool(this);
+			void get(const TreeSearcher& p, ResultSink& ret)const {
+				p.get(exit_node, ret);
 			}
+			NodeHandle put(TreeSearcher& p, NodeHandle self, size_t keyword, size_t id);
 		private:
+			friend TreeSearcher;
 			void cut(TreeSearcher& p, size_t offset);
-			void get(TreeSearcher& p, std::unordered_set<size_t>& ret, size_t offset, size_t start);
-			std::unique_ptr<Node> exit_node = nullptr;
-			size_t start;
-			size_t end;
+			void get(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, size_t offset, size_t start, NodeHandle self)const;
+			NodeHandle exit_node;
+			PoolIndex start;
+			PoolIndex end;
+		};
+
+		//冻结后的只读树，节点按深度优先的先序存放，所以任意子树的结果id在Ids中是连续的一段
+		//子节点是按字符排序的数组，叶子和密集节点的数据都是CSR风格的区间，所有数组都是精确大小
+		class FrozenTree {
+		public:
+			FrozenTree(const TreeSearcher& p, NodeHandle root);
+			void get(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, uint32_t n, size_t offset)const;
+			void reload(const TreeSearcher& p);//PinIn配置变化后重建NAcc的音素索引
+			size_t MemoryUsage()const noexcept;//包括FrozenTree对象本身
+		private:
+			friend TreeSearcher;
+			FrozenTree() = default;//给LoadIndex用
+			void validate(size_t CharCount)const;//检查从文件读入的结构，保证搜索时不会越界，也不会出现环
+			struct Node {//没有隐式填充，可以直接按字节写入文件
+				NodeType type;
+				uint8_t reserved[3];
+				uint32_t acc;//ACC：在accs中的下标
+				uint32_t ChildBegin;//MAP/ACC：子节点区间；SLICE：ChildBegin是出口节点
+				uint32_t ChildEnd;
+				PoolIndex start;//SLICE：字符串池中的区间；DENSE：DenseKeys中的区间
+				PoolIndex end;
+				PoolIndex IdsBegin;//[IdsBegin, OwnEnd)是节点自身的id，[IdsBegin, IdsEnd)是整棵子树的id
+				PoolIndex OwnEnd;
+				PoolIndex IdsEnd;
+			};
+			static_assert(sizeof(Node) == 16 + 5 * sizeof(PoolIndex), "FrozenTree::Node must not contain implicit padding");
+			struct AccIndex {
+				uint32_t node;
+				//音素 -> 首音素匹配的子节点在ChildChars中的下标
+				std::vector<std::pair<PinIn::Phoneme, std::vector<uint32_t>>> phonemes;
+			};
+			uint32_t emit(const TreeSearcher& p, NodeHandle h);
+			template<bool CanUpgrade>
+			void EmitMap(const TreeSearcher& p, const NMapTemplate<CanUpgrade>& m, Node& n);
+			void CollectOwn(const Node& n, ResultSink& ret)const {
+				ret.insert(Ids.data() + n.IdsBegin, Ids.data() + n.OwnEnd);
+			}
+			void CollectAll(const Node& n, ResultSink& ret)const {
+				ret.insert(Ids.data() + n.IdsBegin, Ids.data() + n.IdsEnd);
+			}
+			void GetSlice(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, const Node& n, size_t offset, size_t start)const;
+
+			std::vector<Node> nodes;
+			std::vector<PoolIndex> DenseKeys;
+			std::vector<PoolIndex> Ids;
+			std::vector<uint32_t> ChildChars;
+			std::vector<uint32_t> ChildNodes;
+			std::vector<AccIndex> accs;
 		};
 
 		//密集节点转换临界点 原始版本是128，因为还用一个元素代表了存储的元素列表，这里直接把字符串本身当作元素
@@ -329,32 +848,32 @@ namespace PinInCpp {
 		std::shared_ptr<PinIn> context = nullptr;//PinIn
 		std::unique_ptr<PinIn::Ticket> ticket;
 		UTF8StringPool strs;//应当继续贯彻零拷贝设计
+		const UTF8StringPool* keys = &strs;//put路径读取字符用的池，分片树指向主树的strs
 		Accelerator acc;
 		Logic logic;
 
-		std::unique_ptr<Node> root = nullptr;
-		std::vector<NAcc*> naccs;//观察者，不持有数据
+		NodeHandle root = 0;
+		std::unique_ptr<FrozenTree> frozen = nullptr;
+		SeenIds seen;//非const的搜索接口去重用
+		SearchStats stats;//非const的搜索接口的统计
+		std::shared_ptr<SearchStatsCollector> collector;
+		std::vector<uint64_t> erased;//墓碑位图，按条目首字符的索引编号，也标记Compact时切片借用的已删除字符串
+		size_t ErasedChars = 0;//墓碑位图里的字符串占用的字符数，包括结尾符
+		size_t version = 0;//put/Freeze/LoadIndex/Compact时自增，逐键搜索会话据此判断边界是否还有效
+		std::vector<uint32_t> naccs;//树里所有NAcc节点的下标，配置变化时需要逐个重载索引，Compact回收NAcc后会重建
 
-		ObjectPtrPool<NDense> NDensePool;
-		ObjectPtrPool<NSlice> NSlicePool;
-		ObjectPtrPool<NMap> NMapPool;
-		/*
-		ObjectPtrPool<SizeTList<1>> SizeTList1;
-		ObjectPtrPool<SizeTList<2>> SizeTList2;
-		ObjectPtrPool<SizeTList<4>> SizeTList4;
-		ObjectPtrPool<SizeTList<8>> SizeTList8;
-		ObjectPtrPool<SizeTList<16>> SizeTList16;
-		ObjectPtrPool<SizeTList<32>> SizeTList32;
-		ObjectPtrPool<SizeTList<64>> SizeTList64;
-		ObjectPtrPool<SizeTList<128>> SizeTList128;*/
+		SlabPool<NDense> NDensePool;
+		SlabPool<NSlice> NSlicePool;
+		SlabPool<NMap> NMapPool;
+		SlabPool<NAcc> NAccPool;
 	};
 
 	/* 过长的模板实现 */
 	template<bool CanUpgrade>
-	void TreeSearcher::NMapTemplate<CanUpgrade>::get(TreeSearcher& p, std::unordered_set<size_t>& ret, size_t offset) {
-		if (p.acc.search().size() == offset) {
+	void TreeSearcher::NMapTemplate<CanUpgrade>::get(const TreeSearcher& p, Accelerator& acc, ResultSink& ret, size_t offset)const {
+		if (acc.search().size() == offset) {
 			if (p.logic == Logic::EQUAL) {
-				leaves.AddToSTLSet(ret);
+				leaves.AddToSink(ret);
 			}
 			else {
 				get(p, ret);
@@ -367,46 +886,39 @@ namespace PinInCpp {
 				}
 			}
 			for (const auto& [c, n] : *children) {
-				IndexSet::IndexSetIterObj it = p.acc.get(c, offset).GetIterObj();
+				IndexSet::IndexSetIterObj it = acc.get(c, offset).GetIterObj();
 				for (uint32_t i = it.Next(); i != IndexSetIterEnd; i = it.Next()) {
-					n->get(p, ret, offset + i);
+					RecordLanding(ret, acc, FrontierEntry::MOVE, n, c, offset, offset + i);
+					p.get(n, acc, ret, offset + i);
 				}
 			}
 		}
 	}
 
 	template<bool CanUpgrade>//避免循环依赖，模板实现滞后
-	TreeSearcher::Node* TreeSearcher::NMapTemplate<CanUpgrade>::put(TreeSearcher& p, size_t keyword, size_t id) {
-		if (p.strs.end(keyword)) {//字符串视图不会尝试指向一个\0的字符，用end判断是最安全且合法的
-			leaves.insert(id);
+	TreeSearcher::NodeHandle TreeSearcher::NMapTemplate<CanUpgrade>::put(TreeSearcher& p, NodeHandle self, size_t keyword, size_t id) {
+		if (p.keys->end(keyword)) {//字符串视图不会尝试指向一个\0的字符，用end判断是最安全且合法的
+			leaves.insert(static_cast<PoolIndex>(id));
 		}
 		else {
 			if constexpr (CanUpgrade) {//可升级模式需要懒加载代码，不可升级模式会有构造方移动原始数据，始终安全
 				init();
 			}
-			uint32_t ch = p.strs.getcharFourCC(keyword);
+			uint32_t ch = p.keys->getcharFourCC(keyword);
 			auto it = children->find(ch);//查找
-			Node* sub;
 			if (it == children->end()) {
-				sub = put(ch, p.NDensePool.NewObj());
-			}
-			else {
-				sub = it->second.get();
-			}
-			Node* src = sub;
-			sub = sub->put(p, keyword + 1, id);
-			if (src != sub) {
-				reset_children(p, ch, sub);
+				it = children->emplace(ch, p.NewDense()).first;
 			}
+			p.PutChild(it->second, keyword + 1, id);//unordered_map的元素引用在插入时也是稳定的
 		}
 		if constexpr (CanUpgrade) {
 			if (children != nullptr && children->size() > NMapThreshold) {
-				return new NAcc(p, *this);
+				return p.NewAcc(*this);
 			}
-			return this;
+			return self;
 		}
 		else {//编译时分支
-			return this;
+			return self;
 		}
 	}
 }
@@ -0,0 +1,732 @@
+/*
+TreeSearcher的回归测试，由CMake注册到ctest，每个用例单独运行
+用法：TreeSearcherTest <用例名> <仓库目录(pinyin.txt和small.txt所在的目录)>
+
+用例都是把经过某种操作的树和一棵直接用最终数据构建的树对照搜索结果，结果不一致或者抛出异常都算失败
+配合-fsanitize=address构建可以顺带检查内存错误
+*/
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "TreeSearcher.h"
+#include "ParallelSearch.h"
+#include "SnapshotSearch.h"
+
+using namespace PinInCpp;
+
+namespace {
+	int failures = 0;
+
+	void check(bool ok, const std::string& what) {
+		if (!ok) {
+			std::cerr << "FAILED: " << what << "\n";
+			failures++;
+		}
+	}
+
+	std::string CodePoint(char32_t c) {
+		char buf[5];
+		U32FourCCToCharBuf(buf, UnicodeToUtf8(c));
+		return buf;
+	}
+
+	std::vector<std::string> Sorted(std::vector<std::string> v) {
+		std::sort(v.begin(), v.end());
+		return v;
+	}
+
+	//条目的id是它在字符串池里首字符的字符索引，每个条目占字符数+1(结尾符)
+	class IdTracker {
+	public:
+		size_t put(TreeSearcher& tree, const std::string& s) {
+			tree.put(s);
+			const size_t id = next;
+			next += Utf8StringView(s).size() + 1;
+			return id;
+		}
+	private:
+		size_t next = 0;
+	};
+
+	//对照两棵树在一组查询下的结果，结果和插入顺序无关，所以排序后比较
+	void CompareTrees(TreeSearcher& actual, TreeSearcher& expected, const std::vector<std::string>& queries, const std::string& what) {
+		for (const auto& q : queries) {
+			check(Sorted(actual.ExecuteSearch(q)) == Sorted(expected.ExecuteSearch(q)), what + " query=" + q);
+		}
+	}
+
+	const std::vector<std::string> HanziQueries = { "yi", "y", "ding", "d", "qi", "zh", "z", "x", "yix", "shang" };
+
+	//small.txt的前count个不重复的行
+	std::vector<std::string> LoadLines(const std::string& dir, size_t count) {
+		std::ifstream file(dir + "/small.txt");
+		if (!file) {
+			throw std::runtime_error("can not open small.txt");
+		}
+		std::vector<std::string> result;
+		std::set<std::string> seen;
+		std::string line;
+		while (result.size() < count && std::getline(file, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (!line.empty() && seen.insert(line).second) {
+				result.push_back(line);
+			}
+		}
+		return result;
+	}
+
+	//拼音查询之外，再用部分条目的首字、前两个字和整个字符串查询，EQUAL逻辑只有整串才有结果
+	std::vector<std::string> LineQueries(const std::vector<std::string>& lines) {
+		std::vector<std::string> result = HanziQueries;
+		for (size_t i = 0; i < lines.size(); i += 10) {
+			Utf8StringView u8(lines[i]);
+			result.push_back(std::string(u8[0]));
+			if (u8.size() > 1) {
+				result.push_back(std::string(u8[0]) + std::string(u8[1]));
+			}
+			result.push_back(lines[i]);
+		}
+		return result;
+	}
+
+	std::unique_ptr<TreeSearcher> BuildTree(Logic logic, const std::shared_ptr<PinIn>& pinin, const std::vector<std::string>& lines) {
+		auto tree = std::make_unique<TreeSearcher>(logic, pinin);
+		for (const auto& s : lines) {
+			tree->put(s);
+		}
+		return tree;
+	}
+
+	//按字符串找到条目的id，Compact之后id会重新编号，所以每次都从树里查
+	size_t IdOf(TreeSearcher& tree, const std::string& s) {
+		for (PoolIndex id : tree.ExecuteSearchGetSet(s)) {
+			if (tree.GetStrViewById(id) == s) {
+				return id;
+			}
+		}
+		throw std::runtime_error("entry not found: " + s);
+	}
+
+	//删除、更新和压缩之后，树的搜索结果要和直接用剩下的条目构建的树一致，冻结的树也一样
+	void EraseUpdateCompact(const std::string& dir) {
+		auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+		const std::vector<std::string> lines = LoadLines(dir, 400);
+		const std::vector<std::string> queries = LineQueries(lines);
+		for (Logic logic : { Logic::BEGIN, Logic::CONTAIN, Logic::EQUAL }) {
+			for (bool frozen : { false, true }) {
+				const std::string what = std::string(logic == Logic::BEGIN ? "BEGIN" : logic == Logic::CONTAIN ? "CONTAIN" : "EQUAL") + (frozen ? " frozen " : " ");
+				std::unique_ptr<TreeSearcher> tree = BuildTree(logic, pinin, lines);
+				if (frozen) {
+					tree->Freeze();
+				}
+				std::vector<std::string> live;
+				for (size_t i = 0; i < lines.size(); i++) {
+					if (i % 3 == 0) {
+						check(tree->erase(IdOf(*tree, lines[i])), what + "erase");
+					}
+					else {
+						live.push_back(lines[i]);
+					}
+				}
+				check(!tree->erase(IdOf(*tree, live[0]) + 1), what + "erase non-entry");
+				CompareTrees(*tree, *BuildTree(logic, pinin, live), queries, what + "erase");
+
+				if (!frozen) {
+					for (size_t i = 0; i < live.size(); i += 5) {
+						const std::string updated = live[i] + "新";
+						tree->update(IdOf(*tree, live[i]), updated);
+						live[i] = updated;
+					}
+					CompareTrees(*tree, *BuildTree(logic, pinin, live), queries, what + "update");
+				}
+
+				tree->Compact();
+				check(tree->IsFrozen() == frozen, what + "frozen after compact");
+				CompareTrees(*tree, *BuildTree(logic, pinin, live), queries, what + "compact");
+
+				//压缩后的id重新编号了，继续删除和插入
+				std::vector<std::string> rest;
+				for (size_t i = 0; i < live.size(); i++) {
+					if (i % 4 == 1) {
+						check(tree->erase(IdOf(*tree, live[i])), what + "erase after compact");
+					}
+					else {
+						rest.push_back(live[i]);
+					}
+				}
+				if (!frozen) {
+					for (size_t i = 0; i < lines.size(); i += 3) {
+						tree->put(lines[i]);
+						rest.push_back(lines[i]);
+					}
+				}
+				CompareTrees(*tree, *BuildTree(logic, pinin, rest), queries, what + "compact+erase+put");
+			}
+		}
+	}
+
+	//Compact回收了NAcc之后，配置变化的回调不能再碰已经回收的NAcc
+	void CompactThenCommit(const std::string& dir) {
+		for (Logic logic : { Logic::BEGIN, Logic::CONTAIN }) {
+			auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+			TreeSearcher tree(logic, pinin);
+			std::vector<std::string> all;
+			for (char32_t k = 0; k < 80; k++) {
+				all.push_back(CodePoint(0x4E00 + k * 7) + "x");
+			}
+			IdTracker ids;
+			std::vector<size_t> id;
+			for (const auto& s : all) {
+				id.push_back(ids.put(tree, s));
+			}
+			std::vector<std::string> kept;
+			for (size_t i = 0; i < all.size(); i++) {
+				if (i < 20) {
+					kept.push_back(all[i]);
+				}
+				else {
+					check(tree.erase(id[i]), "erase");
+				}
+			}
+			tree.Compact();
+			{
+				PinIn::Config cfg = pinin->config();
+				cfg.fZh2Z = true;
+				cfg.commit();
+			}
+			TreeSearcher expected(logic, pinin);
+			for (const auto& s : kept) {
+				expected.put(s);
+			}
+			CompareTrees(tree, expected, HanziQueries, "compact+commit");
+			//再插入一些，让降级后的节点重新升级，然后再改一次配置
+			for (char32_t k = 0; k < 80; k++) {
+				const std::string s = CodePoint(0x4E01 + k * 5) + "y";
+				tree.put(s);
+				expected.put(s);
+			}
+			{
+				PinIn::Config cfg = pinin->config();
+				cfg.fZh2Z = false;
+				cfg.fIng2In = true;
+				cfg.commit();
+			}
+			CompareTrees(tree, expected, HanziQueries, "compact+put+commit");
+		}
+	}
+
+	/*
+	CONTAIN的根节点升级成NAcc之后，第一次搜索就要按部分匹配处理，"yi"要能匹配到"隐"(yin)
+	这组条目刚好让根节点升级，而且遍历时在碰到"隐"之前不会经过密集节点。树自己的搜索和独立的查询上下文结果要一致
+	*/
+	void FirstSearchPartial(const std::string& dir) {
+		auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+		const std::vector<std::string> lines = {
+			"装饰用绿色石英方块", "油菜种子0", "一杯咖啡", "工程师红外眼镜",
+			"高级药水指环- 跳跃提升", "钻头时运升级II（效果等同时运III）", "亚麻种子", "激光中继器：隐形"
+		};
+		TreeSearcher tree(Logic::CONTAIN, pinin);
+		for (const auto& s : lines) {
+			tree.put(s);
+		}
+		TreeSearcher::SearchContext ctx(tree);
+		const std::vector<std::string> first = tree.ExecuteSearch("yi");
+		check(std::find(first.begin(), first.end(), lines.back()) != first.end(), "first search yi");
+		check(Sorted(first) == Sorted(tree.ExecuteSearch(ctx, "yi")), "tree and context");
+	}
+
+	/*
+	SaveIndex写出的文件加载到另一棵树上，搜索结果要和直接构建的树一致，已删除的条目加载后依然不可见
+	未冻结和冻结的树都保存一次，加载后的树是冻结的，然后继续在上面删除和压缩
+	*/
+	void IndexRoundTrip(const std::string& dir) {
+		auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+		const std::vector<std::string> lines = LoadLines(dir, 400);
+		const std::vector<std::string> queries = LineQueries(lines);
+		const std::string path = (std::filesystem::temp_directory_path() / "PinInCppTreeSearcherTest.idx").string();
+		for (Logic logic : { Logic::BEGIN, Logic::CONTAIN, Logic::EQUAL }) {
+			for (bool frozen : { false, true }) {
+				const std::string what = std::string(logic == Logic::BEGIN ? "BEGIN" : logic == Logic::CONTAIN ? "CONTAIN" : "EQUAL") + (frozen ? " frozen " : " ");
+				std::unique_ptr<TreeSearcher> tree = BuildTree(logic, pinin, lines);
+				if (frozen) {
+					tree->Freeze();
+				}
+				std::vector<std::string> live;
+				for (size_t i = 0; i < lines.size(); i++) {
+					if (i % 5 == 2) {
+						tree->erase(IdOf(*tree, lines[i]));
+					}
+					else {
+						live.push_back(lines[i]);
+					}
+				}
+				tree->SaveIndex(path);
+				TreeSearcher loaded(logic, pinin);
+				loaded.LoadIndex(path);
+				check(loaded.IsFrozen(), what + "frozen after load");
+				CompareTrees(loaded, *tree, queries, what + "load vs saved");
+				CompareTrees(loaded, *BuildTree(logic, pinin, live), queries, what + "load vs fresh");
+
+				std::vector<std::string> rest;
+				for (size_t i = 0; i < live.size(); i++) {
+					if (i % 3 == 0) {
+						check(loaded.erase(IdOf(loaded, live[i])), what + "erase after load");
+					}
+					else {
+						rest.push_back(live[i]);
+					}
+				}
+				loaded.Compact();
+				CompareTrees(loaded, *BuildTree(logic, pinin, rest), queries, what + "load+erase+compact");
+
+				//逻辑不一致的文件要拒绝加载
+				TreeSearcher other(logic == Logic::EQUAL ? Logic::BEGIN : Logic::EQUAL, pinin);
+				bool rejected = false;
+				try {
+					other.LoadIndex(path);
+				}
+				catch (const TreeIndexInvalid&) {
+					rejected = true;
+				}
+				check(rejected, what + "reject other logic");
+			}
+		}
+		std::filesystem::remove(path);
+	}
+
+	/*
+	只有一棵树时线程池只有一个工作线程，done在这个线程上调用的话，done里的put会等待排在它后面的异步搜索离开闸门，
+	而那些搜索再也等不到工作线程，所以done必须在线程池外面调用。死锁时这个用例会卡住，由ctest的超时判定失败
+	*/
+	void AsyncSingleTree(const std::string& dir) {
+		auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+		ParallelSearch ps(Logic::BEGIN, pinin, 1);
+		TreeSearcher expected(Logic::BEGIN, pinin);
+		for (char32_t k = 0; k < 40; k++) {
+			const std::string s = CodePoint(0x4E00 + k * 3);
+			ps.put(s);
+			expected.put(s);
+		}
+		constexpr size_t QueryNum = 32;
+		std::mutex mtx;
+		std::condition_variable cv;
+		size_t finished = 0;
+		size_t errors = 0;
+		for (size_t i = 0; i < QueryNum; i++) {
+			const std::string q = HanziQueries[i % HanziQueries.size()];
+			ps.ExecuteSearchAsync(q, [&, i](std::vector<std::string>, std::exception_ptr error) {
+				ps.put(CodePoint(0x5000 + static_cast<char32_t>(i)));//在done里修改
+				std::lock_guard<std::mutex> lk(mtx);
+				errors += error != nullptr;
+				finished++;
+				cv.notify_all();
+			});
+		}
+		{
+			std::unique_lock<std::mutex> lk(mtx);
+			cv.wait(lk, [&]() {
+				return finished == QueryNum;
+			});
+		}
+		check(errors == 0, "async error");
+		for (size_t i = 0; i < QueryNum; i++) {
+			expected.put(CodePoint(0x5000 + static_cast<char32_t>(i)));
+		}
+		for (const auto& q : HanziQueries) {
+			check(Sorted(ps.ExecuteSearch(q)) == Sorted(expected.ExecuteSearch(q)), "async+put query=" + q);
+		}
+	}
+
+	//快照里的条目id，发布的两棵树id一致，所以可以直接用于写入
+	size_t IdOf(SnapshotSearch& ss, SnapshotSearch::Reader& reader, const std::string& s) {
+		SnapshotSearch::Snapshot snapshot = ss.acquire();
+		for (PoolIndex id : snapshot.tree().ExecuteSearchGetSet(reader.context(snapshot), s)) {
+			if (snapshot.tree().GetStrViewById(id) == s) {
+				return id;
+			}
+		}
+		throw std::runtime_error("entry not found: " + s);
+	}
+
+	void CompareSnapshot(SnapshotSearch::Reader& reader, TreeSearcher& expected, const std::vector<std::string>& queries, const std::string& what) {
+		for (const auto& q : queries) {
+			check(Sorted(reader.ExecuteSearch(q)) == Sorted(expected.ExecuteSearch(q)), what + " query=" + q);
+		}
+	}
+
+	/*
+	每次publish之后，前台的树要和直接用当前条目构建的树一致，publish之前读者看到的还是上一个版本
+	连续发布多次，让两棵树都经过重放：每棵树的修改有一半是自己执行的，一半是重放另一棵树的日志
+	*/
+	void SnapshotReplay(const std::string& dir) {
+		auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+		const std::vector<std::string> lines = LoadLines(dir, 300);
+		const std::vector<std::string> queries = LineQueries(lines);
+		for (Logic logic : { Logic::BEGIN, Logic::CONTAIN }) {
+			const std::string what = logic == Logic::BEGIN ? "BEGIN " : "CONTAIN ";
+			SnapshotSearch ss(logic, pinin);
+			SnapshotSearch::Reader reader(ss);
+			std::vector<std::string> live;
+			for (size_t i = 0; i < lines.size() / 2; i++) {
+				ss.put(lines[i]);
+				live.push_back(lines[i]);
+			}
+			ss.publish();
+			CompareSnapshot(reader, *BuildTree(logic, pinin, live), queries, what + "publish");
+
+			for (size_t round = 0; round < 4; round++) {
+				const std::string step = what + "round " + std::to_string(round) + " ";
+				const size_t version = ss.acquire().version();
+				std::vector<std::string> next;
+				for (size_t i = 0; i < live.size(); i++) {
+					if (i % 4 == round % 4) {
+						check(ss.erase(IdOf(ss, reader, live[i])), step + "erase");
+					}
+					else if (i % 7 == round) {
+						const std::string updated = live[i] + std::to_string(round);
+						ss.update(IdOf(ss, reader, live[i]), updated);
+						next.push_back(updated);
+					}
+					else {
+						next.push_back(live[i]);
+					}
+				}
+				for (size_t i = lines.size() / 2 + round; i < lines.size(); i += 4) {
+					ss.put(lines[i]);
+					next.push_back(lines[i]);
+				}
+				if (round % 2 == 1) {
+					ss.Compact();
+				}
+				//还没有发布，读者看到的依然是旧版本
+				check(ss.acquire().version() == version, step + "version before publish");
+				CompareSnapshot(reader, *BuildTree(logic, pinin, live), queries, step + "before publish");
+				ss.publish();
+				live = std::move(next);
+				check(ss.acquire().version() == version + 1, step + "version after publish");
+				CompareSnapshot(reader, *BuildTree(logic, pinin, live), queries, step + "after publish");
+			}
+		}
+	}
+
+	/*
+	PutBatch和逐个put的结果要一致，两棵树的字符串池顺序相同，所以连id集合都要一样
+	覆盖根节点只插入过空字符串(NMap没有子节点表)、根节点还没升级、以及第二批落在根节点已有子节点上的情况
+	*/
+	void BatchMatchesPut(const std::string& dir) {
+		auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+		const std::vector<std::string> lines = LoadLines(dir, 400);
+		std::vector<std::string> queries = LineQueries(lines);
+		queries.push_back("");
+		WorkStealingPool pool(4);
+		const std::vector<std::vector<std::string>> EmptyRoot = {
+			std::vector<std::string>(400, ""),
+			{ "abc", "中文" },
+			std::vector<std::string>(lines.begin(), lines.begin() + 200),
+			std::vector<std::string>(lines.begin() + 100, lines.end()),//前一半和上一批重复，首字符都已经在根节点下
+		};
+		const std::vector<std::vector<std::string>> SmallFirst = {
+			std::vector<std::string>(lines.begin(), lines.begin() + 3),//根节点还是NDense，第二批先逐个插入直到它升级
+			std::vector<std::string>(lines.begin() + 3, lines.begin() + 250),
+			std::vector<std::string>(lines.begin() + 150, lines.end()),
+		};
+		for (Logic logic : { Logic::BEGIN, Logic::CONTAIN, Logic::EQUAL }) {
+			for (const auto* batches : { &EmptyRoot, &SmallFirst }) {
+				const std::string what = std::string(logic == Logic::BEGIN ? "BEGIN" : logic == Logic::CONTAIN ? "CONTAIN" : "EQUAL")
+					+ (batches == &EmptyRoot ? " empty root " : " small first ");
+				TreeSearcher batched(logic, pinin);
+				TreeSearcher sequential(logic, pinin);
+				for (size_t b = 0; b < batches->size(); b++) {
+					const std::vector<std::string>& batch = (*batches)[b];
+					const std::vector<std::string_view> views(batch.begin(), batch.end());
+					batched.PutBatch(views, pool);
+					for (const auto& s : batch) {
+						sequential.put(s);
+					}
+					const std::string step = what + "batch " + std::to_string(b);
+					CompareTrees(batched, sequential, queries, step);
+					for (const auto& q : queries) {
+						check(batched.ExecuteSearchGetSet(q) == sequential.ExecuteSearchGetSet(q), step + " ids query=" + q);
+					}
+				}
+			}
+		}
+	}
+
+	//逐个输入一个字符串，每次多一个字符，中文按字符而不是字节切分
+	void Type(std::vector<std::string>& keys, const std::string& base, const std::string& word) {
+		std::string s = base;
+		for (const auto& ch : Utf8StringView(word)) {
+			s += ch;
+			keys.push_back(s);
+		}
+	}
+
+	/*
+	逐键搜索会话：追加字符时从边界继续，退格、修改、树被修改和配置变化时退回完整搜索
+	每一步的结果都要和同一棵树上的完整搜索一致
+	*/
+	void SearchSessionReplay(const std::string& dir) {
+		const std::vector<std::string> lines = LoadLines(dir, 400);
+		for (Logic logic : { Logic::BEGIN, Logic::CONTAIN, Logic::EQUAL }) {
+			const std::string what = logic == Logic::BEGIN ? "BEGIN " : logic == Logic::CONTAIN ? "CONTAIN " : "EQUAL ";
+			auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");//每种逻辑各改一次配置，不和其他用例共享
+			std::unique_ptr<TreeSearcher> tree = BuildTree(logic, pinin, lines);
+			TreeSearcher::SearchSession session(*tree);
+			size_t step = 0;
+			auto search = [&](const std::string& q) {
+				const std::string where = what + "step " + std::to_string(step++) + " query=" + q;
+				check(tree->ExecuteSearchGetSet(session, q) == tree->ExecuteSearchGetSet(q), where);
+			};
+			auto replay = [&](const std::vector<std::string>& keys) {
+				for (const auto& q : keys) {
+					search(q);
+				}
+			};
+			std::vector<std::string> keys;
+			Type(keys, "", "zhongwen");
+			keys.push_back("zhongwe");//退格
+			keys.push_back("zhongw");
+			Type(keys, "zhongw", "ai");
+			keys.push_back("zhangwai");//修改中间的字符
+			Type(keys, "", "jiguangzhongjiqi");
+			for (size_t i = 0; i < lines.size(); i += 37) {//直接输入汉字，以及汉字后面接拼音
+				Type(keys, "", lines[i]);
+				Utf8StringView u8(lines[i]);
+				Type(keys, std::string(u8[0]), "yin");
+			}
+			replay(keys);
+
+			//输入到一半插入新条目，版本变了，下一次搜索不能再用旧边界
+			keys.clear();
+			Type(keys, "", "yi");
+			replay(keys);
+			tree->put("隐形眼镜");
+			keys.clear();
+			Type(keys, "yi", "nxing");
+			Type(keys, "", "隐形");
+			replay(keys);
+
+			//输入到一半改配置，模糊音让之前匹配不上的条目匹配上
+			keys.clear();
+			Type(keys, "", "zo");
+			replay(keys);
+			{
+				PinIn::Config cfg = pinin->config();
+				cfg.fZh2Z = true;
+				cfg.fAng2An = true;
+				cfg.commit();
+			}
+			keys.clear();
+			Type(keys, "zo", "ngwen");
+			Type(keys, "", "zhan");
+			replay(keys);
+
+			//删除、压缩和冻结之后继续输入
+			tree->erase(IdOf(*tree, lines[0]));
+			search("z");
+			tree->Compact();
+			search("zh");
+			tree->Freeze();
+			keys.clear();
+			Type(keys, "", "zhongwen");
+			Type(keys, "", lines[1]);
+			replay(keys);
+			session.reset();
+			replay(keys);
+		}
+	}
+
+	//完整搜索后按分数从高到低、同分按id从小到大排序，取前k个，作为ExecuteSearchTopK的参照
+	std::vector<std::pair<int64_t, PoolIndex>> RankAll(TreeSearcher& tree, const std::string& q, const TreeSearcher::Scorer& scorer) {
+		std::vector<std::pair<int64_t, PoolIndex>> ranked;
+		for (PoolIndex id : tree.ExecuteSearchGetSet(q)) {
+			ranked.emplace_back(scorer(id, tree.GetStrViewById(id)), id);
+		}
+		std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+			return a.first != b.first ? a.first > b.first : a.second < b.second;
+		});
+		return ranked;
+	}
+
+	/*
+	Top-K：没有提前结束时，结果和排好序的完整搜索的前k个完全一致，包括同分按id的顺序
+	提前结束时，结果都达到上界，并且打分次数少于完整搜索的结果数
+	*/
+	void TopK(const std::string& dir) {
+		auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+		std::vector<std::string> lines = LoadLines(dir, 400);
+		for (size_t i = 0; i < 300; i++) {//原文以"a"开头、中间含"a"和只有拼音能匹配的条目都有
+			lines.push_back("ab" + std::to_string(i * 7919 % 1000));
+			lines.push_back("x" + std::to_string(i) + "ab");
+		}
+		const std::vector<std::string> queries = { "a", "ab", "ab1", "yi", "y", "zh", "d", "x" };
+		for (Logic logic : { Logic::BEGIN, Logic::CONTAIN, Logic::EQUAL }) {
+			const std::string what = logic == Logic::BEGIN ? "BEGIN " : logic == Logic::CONTAIN ? "CONTAIN " : "EQUAL ";
+			std::unique_ptr<TreeSearcher> tree = BuildTree(logic, pinin, lines);
+			TreeSearcher::SearchContext ctx(*tree);
+			for (const auto& q : queries) {
+				for (size_t k : { 1, 5, 50 }) {
+					const std::string where = what + "query=" + q + " k=" + std::to_string(k);
+					//默认打分：第一档不足k个时不会提前结束，结果必须精确
+					TreeSearcher::Scorer def = [&q](PoolIndex, std::string_view str) {
+						return TreeSearcher::DefaultScore(q, str);
+					};
+					const auto ranked = RankAll(*tree, q, def);
+					const std::vector<std::string> top = tree->ExecuteSearchTopK(q, k);
+					check(top == tree->ExecuteSearchTopK(ctx, q, k), where + " tree vs context");
+					check(top.size() == std::min(k, ranked.size()), where + " default size");
+					size_t prefixed = 0;
+					for (const auto& [score, id] : ranked) {
+						prefixed += tree->GetStrViewById(id).starts_with(q);
+					}
+					if (prefixed < k) {
+						for (size_t i = 0; i < top.size(); i++) {
+							check(top[i] == tree->GetStrViewById(ranked[i].second), where + " default rank " + std::to_string(i));
+						}
+					}
+					else {//第一档够k个，提前结束，结果都在第一档，按长度排序
+						for (size_t i = 0; i < top.size(); i++) {
+							check(top[i].starts_with(q), where + " default top tier " + std::to_string(i));
+							check(i == 0 || top[i - 1].size() <= top[i].size(), where + " default order " + std::to_string(i));
+						}
+					}
+
+					//只分三档的打分，大量并列，不给上界时并列的按id排序
+					size_t calls = 0;
+					TreeSearcher::Scorer tiers = [&calls](PoolIndex id, std::string_view) {
+						calls++;
+						return -static_cast<int64_t>(id % 3);
+					};
+					const auto tied = RankAll(*tree, q, tiers);
+					calls = 0;
+					const std::vector<std::string> exact = tree->ExecuteSearchTopK(q, k, tiers);
+					check(calls == tied.size(), where + " no bound scores every result");
+					check(exact.size() == std::min(k, tied.size()), where + " ties size");
+					for (size_t i = 0; i < exact.size(); i++) {
+						check(exact[i] == tree->GetStrViewById(tied[i].second), where + " ties rank " + std::to_string(i));
+					}
+					//给出上界0，第一档够k个时提前结束，之后交过来的结果不再打分
+					size_t best = 0;
+					for (const auto& [score, id] : tied) {
+						best += score == 0;
+					}
+					calls = 0;
+					const std::vector<std::string> bounded = tree->ExecuteSearchTopK(q, k, tiers, 0);
+					check(bounded.size() == exact.size(), where + " bounded size");
+					if (best >= k) {
+						//第一档多于k个时，第k个进入第一档之后至少还有一个没有遍历到
+						check(best == k || calls < tied.size(), where + " early stop");
+						for (const auto& s : bounded) {
+							check(tiers(IdOf(*tree, s), s) == 0, where + " bounded top tier");
+						}
+					}
+					else {
+						check(bounded == exact, where + " bounded without stop");
+					}
+				}
+			}
+		}
+	}
+
+	/*
+	单棵树内的并行搜索：根节点的分支分发到线程池，结果要和单线程的完整搜索一致
+	树足够大，根节点是NAcc，冻结前后、配置变化后、以及两个调用线程共享同一个线程池时都要一致
+	*/
+	void ParallelContextSearch(const std::string& dir) {
+		const std::vector<std::string> lines = LoadLines(dir, 3000);
+		std::vector<std::string> queries = LineQueries(std::vector<std::string>(lines.begin(), lines.begin() + 400));
+		queries.push_back("");
+		for (Logic logic : { Logic::BEGIN, Logic::CONTAIN, Logic::EQUAL }) {
+			const std::string what = logic == Logic::BEGIN ? "BEGIN " : logic == Logic::CONTAIN ? "CONTAIN " : "EQUAL ";
+			auto pinin = std::make_shared<PinIn>(dir + "/pinyin.txt");
+			std::unique_ptr<TreeSearcher> tree = BuildTree(logic, pinin, lines);
+			check(tree->MemoryUsage().AccNodes.count != 0, what + "tree has NAcc");
+			for (size_t threads : { 1, 4 }) {
+				WorkStealingPool pool(threads);
+				TreeSearcher::ParallelContext ctx(*tree, pool);
+				auto compare = [&](const std::string& step) {
+					for (const auto& q : queries) {
+						const std::string where = what + step + " threads=" + std::to_string(threads) + " query=" + q;
+						check(tree->ExecuteSearchGetSet(ctx, q) == tree->ExecuteSearchGetSet(q), where);
+						check(Sorted(tree->ExecuteSearch(ctx, q)) == Sorted(tree->ExecuteSearch(q)), where + " strings");
+					}
+				};
+				compare("live");
+				{
+					PinIn::Config cfg = pinin->config();
+					cfg.fZh2Z = !cfg.fZh2Z;
+					cfg.commit();
+				}
+				compare("commit");
+			}
+			tree->Freeze();
+			WorkStealingPool pool(4);
+			std::vector<std::unordered_set<PoolIndex>> expected;
+			for (const auto& q : queries) {
+				expected.push_back(tree->ExecuteSearchGetSet(q));
+			}
+			//两个线程各自持有上下文，共享线程池，同时搜索冻结的树
+			std::vector<size_t> bad(2);
+			std::vector<std::thread> callers;
+			for (size_t t = 0; t < 2; t++) {
+				callers.emplace_back([&, t]() {
+					TreeSearcher::ParallelContext ctx(*tree, pool);
+					for (size_t i = 0; i < queries.size(); i++) {
+						bad[t] += tree->ExecuteSearchGetSet(ctx, queries[i]) != expected[i];
+					}
+				});
+			}
+			for (auto& c : callers) {
+				c.join();
+			}
+			check(bad[0] == 0 && bad[1] == 0, what + "frozen concurrent callers");
+		}
+	}
+
+	const std::map<std::string, std::function<void(const std::string&)>> cases = {
+		{ "erase_update_compact", EraseUpdateCompact },
+		{ "compact_commit", CompactThenCommit },
+		{ "first_search_partial", FirstSearchPartial },
+		{ "snapshot_replay", SnapshotReplay },
+		{ "index_round_trip", IndexRoundTrip },
+		{ "put_batch", BatchMatchesPut },
+		{ "search_session", SearchSessionReplay },
+		{ "top_k", TopK },
+		{ "parallel_context", ParallelContextSearch },
+		{ "async_single_tree", AsyncSingleTree },
+	};
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3 || cases.count(argv[1]) == 0) {
+		std::cerr << "usage: TreeSearcherTest <case> <repo dir>\ncases:";
+		for (const auto& [name, fn] : cases) {
+			std::cerr << " " << name;
+		}
+		std::cerr << "\n";
+		return 2;
+	}
+	try {
+		cases.at(argv[1])(argv[2]);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "FAILED: exception " << e.what() << "\n";
+		return 1;
+	}
+	if (failures != 0) {
+		std::cerr << failures << " check(s) failed\n";
+		return 1;
+	}
+	return 0;
+}
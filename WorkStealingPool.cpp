@@ -0,0 +1,162 @@
+#include "WorkStealingPool.h"
+
+#include <chrono>
+
+namespace PinInCpp {
+	static thread_local const WorkStealingPool* CurrentPool = nullptr;
+	static thread_local size_t CurrentIndex = 0;
+
+	WorkStealingPool::WorkStealingPool(size_t ThreadNum) {
+		if (ThreadNum == 0) {//hardware_concurrency可能返回0
+			ThreadNum = 1;
+		}
+		queues.reserve(ThreadNum);
+		for (size_t i = 0; i < ThreadNum; i++) {
+			queues.push_back(std::make_unique<Queue>());
+		}
+		workers.reserve(ThreadNum);
+		for (size_t i = 0; i < ThreadNum; i++) {
+			workers.emplace_back([this, i]() {
+				WorkerLoop(i);
+			});
+		}
+	}
+
+	WorkStealingPool::~WorkStealingPool() {
+		{
+			std::lock_guard<std::mutex> lk(SleepMtx);
+			StopFlag = true;
+		}
+		SleepCv.notify_all();
+		for (auto& v : workers) {
+			if (v.joinable()) {
+				v.join();
+			}
+		}
+	}
+
+	size_t WorkStealingPool::WorkerIndex()const noexcept {
+		return CurrentPool == this ? CurrentIndex : workers.size();
+	}
+
+	void WorkStealingPool::submit(TaskGroup& group, std::function<void()> task) {
+		group.pending++;
+		push(Task{ std::move(task), &group });
+	}
+
+	void WorkStealingPool::post(std::function<void()> task) {
+		push(Task{ std::move(task), nullptr });
+	}
+
+	void WorkStealingPool::push(Task task) {
+		size_t index = WorkerIndex();
+		if (index == queues.size()) {
+			index = NextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+		}
+		{
+			Queue& q = *queues[index];
+			std::lock_guard<std::mutex> lk(q.mtx);
+			q.tasks.push_back(std::move(task));
+		}
+		queued++;
+		{//先拿一次锁，保证正在检查条件准备休眠的线程不会错过这次通知
+			std::lock_guard<std::mutex> lk(SleepMtx);
+		}
+		SleepCv.notify_one();
+	}
+
+	void WorkStealingPool::wait(TaskGroup& group) {
+		const size_t self = WorkerIndex();
+		while (group.pending.load() != 0) {
+			if (self == workers.size() || !TryRun(self)) {//外部线程，或者没有可以帮忙的任务，剩下的任务正在其他线程上执行
+				std::unique_lock<std::mutex> lk(group.mtx);
+				group.cv.wait_for(lk, std::chrono::milliseconds(1), [&group]() {
+					return group.pending.load() == 0;
+				});
+			}
+		}
+		std::exception_ptr error;
+		{//最后一个任务在锁内完成计数和通知，拿到锁之后group才可以安全地析构
+			std::lock_guard<std::mutex> lk(group.mtx);
+			error = std::move(group.error);
+			group.error = nullptr;
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	bool WorkStealingPool::TryRun(size_t self) {
+		const size_t n = queues.size();
+		Task task;
+		bool found = false;
+		{//自己的队列从尾部取
+			Queue& q = *queues[self];
+			std::lock_guard<std::mutex> lk(q.mtx);
+			if (!q.tasks.empty()) {
+				task = std::move(q.tasks.back());
+				q.tasks.pop_back();
+				found = true;
+			}
+		}
+		for (size_t i = 1; !found && i < n; i++) {//从其他队列的头部窃取
+			Queue& q = *queues[(self + i) % n];
+			std::lock_guard<std::mutex> lk(q.mtx);
+			if (!q.tasks.empty()) {
+				task = std::move(q.tasks.front());
+				q.tasks.pop_front();
+				found = true;
+			}
+		}
+		if (!found) {
+			return false;
+		}
+		queued--;
+		run(task);
+		return true;
+	}
+
+	void WorkStealingPool::RunDetached(std::function<void()>& func)noexcept {
+		func();
+		func = nullptr;
+	}
+
+	void WorkStealingPool::run(Task& task) {
+		if (task.group == nullptr) {
+			RunDetached(task.func);
+			return;
+		}
+		TaskGroup& group = *task.group;
+		try {
+			task.func();
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lk(group.mtx);
+			if (!group.error) {
+				group.error = std::current_exception();
+			}
+		}
+		task.func = nullptr;//捕获的状态在计数归零之前释放
+		std::lock_guard<std::mutex> lk(group.mtx);
+		if (--group.pending == 0) {
+			group.cv.notify_all();
+		}
+	}
+
+	void WorkStealingPool::WorkerLoop(size_t index) {
+		CurrentPool = this;
+		CurrentIndex = index;
+		while (true) {
+			if (TryRun(index)) {
+				continue;
+			}
+			std::unique_lock<std::mutex> lk(SleepMtx);
+			SleepCv.wait(lk, [this]() {
+				return StopFlag || queued.load() != 0;
+			});
+			if (StopFlag && queued.load() == 0) {
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstddef>
+
+namespace PinInCpp {
+	/*
+	工作窃取线程池，每个工作线程有自己的任务队列
+
+	工作线程优先从自己队列的尾部取任务(后进先出，刚拆出来的子任务数据还在缓存里)，自己没有任务时从其他线程队列的头部窃取
+	任务按TaskGroup分组，wait等待一组任务完成。工作线程在等待期间会帮忙执行任务，所以在任务内部提交并等待子任务不会死锁
+	外部线程只是阻塞等待，不执行任务，这样任务可以放心地按WorkerIndex()使用每个工作线程各自的状态
+	*/
+	class WorkStealingPool {
+	public:
+		class TaskGroup {//一组任务的完成计数，同一组的任务抛出的第一个异常会在wait时重新抛出
+		public:
+			TaskGroup() = default;
+			TaskGroup(const TaskGroup&) = delete;
+			TaskGroup& operator=(const TaskGroup&) = delete;
+		private:
+			friend WorkStealingPool;
+			std::atomic<size_t> pending = 0;
+			std::mutex mtx;
+			std::condition_variable cv;
+			std::exception_ptr error;
+		};
+
+		explicit WorkStealingPool(size_t ThreadNum = std::thread::hardware_concurrency());
+		~WorkStealingPool();
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool(WorkStealingPool&&) = delete;
+		WorkStealingPool& operator=(WorkStealingPool&& src) = delete;
+
+		//提交任务，工作线程内提交时放进自己的队列，外部线程提交时轮流放进各个队列
+		void submit(TaskGroup& group, std::function<void()> task);
+		//提交一个不属于任何TaskGroup的任务，提交方不等待它，任务需要自己处理异常，抛出异常时调用std::terminate
+		void post(std::function<void()> task);
+		//等待这一组任务全部完成，工作线程调用时期间帮忙执行任务(不一定是这一组的)
+		void wait(TaskGroup& group);
+
+		size_t size()const noexcept {//工作线程数
+			return workers.size();
+		}
+		//当前线程在这个线程池里的编号，范围[0, size())，不是这个线程池的工作线程时返回size()
+		size_t WorkerIndex()const noexcept;
+	private:
+		struct Task {
+			std::function<void()> func;
+			TaskGroup* group;//post的任务为空
+		};
+		struct alignas(64) Queue {//各占一条缓存行，避免相邻队列的锁互相干扰
+			std::mutex mtx;
+			std::deque<Task> tasks;
+		};
+		void push(Task task);
+		bool TryRun(size_t self);
+		void run(Task& task);
+		static void RunDetached(std::function<void()>& func)noexcept;
+		void WorkerLoop(size_t index);
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<size_t> queued = 0;//所有队列里的任务总数，空闲线程据此休眠
+		std::atomic<size_t> NextQueue = 0;
+		std::mutex SleepMtx;
+		std::condition_variable SleepCv;
+		bool StopFlag = false;
+	};
+}